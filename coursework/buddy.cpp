@@ -12,6 +12,9 @@
 #include <infos/kernel/log.h>
 #include <infos/util/math.h>
 #include <infos/util/printf.h>
+#include <infos/util/lock.h>
+
+#include "shrinker.h"
 
 using namespace infos::kernel;
 using namespace infos::mm;
@@ -21,6 +24,57 @@ using namespace infos::util;
 //the highest order in free_areas (the last index in the array) will be the index == MAX_ORDER
 #define MAX_ORDER 17 
 
+//When the number of free pages would drop below this many, registered caches are asked to give memory back
+#define LOW_WATERMARK_PAGES 1024
+//While free memory stays below the watermark, the caches are asked again at most once per this many allocations
+#define RECLAIM_INTERVAL_ALLOCATIONS 64
+
+namespace reclaim {
+	ReclaimStats reclaim_stats;
+
+	//The list of registered shrinkers, in registration order
+	static Shrinker *shrinkers_head = NULL, *shrinkers_tail = NULL;
+
+	/**
+	 * Registers a cache to be asked for memory when the page allocator runs low.
+	 * @param shrinker The shrinker to register.  Registering the same shrinker twice has no effect.
+	 */
+	void register_shrinker(Shrinker& shrinker)
+	{
+		UniqueIRQLock l;
+
+		if (shrinker._registered) return;
+		shrinker._registered = true;
+
+		if (shrinkers_tail == NULL) {
+			shrinkers_head = &shrinker;
+		} else {
+			shrinkers_tail->_next_shrinker = &shrinker;
+		}
+
+		shrinkers_tail = &shrinker;
+	}
+
+	/**
+	 * Asks the registered shrinkers, in order, to release memory until the target is met.
+	 * @param nr_pages The number of pages to try to reclaim.
+	 * @return Returns the number of pages that were reclaimed.
+	 */
+	uint64_t shrink_caches(uint64_t nr_pages)
+	{
+		uint64_t reclaimed = 0;
+
+		reclaim_stats.reclaim_runs++;
+
+		for (Shrinker *shrinker = shrinkers_head; shrinker != NULL && reclaimed < nr_pages; shrinker = shrinker->_next_shrinker) {
+			reclaimed += shrinker->shrink(nr_pages - reclaimed);
+		}
+
+		reclaim_stats.reclaimed_pages += reclaimed;
+		return reclaimed;
+	}
+}
+
 
 /**
  * A buddy page allocation algorithm.
@@ -222,7 +276,7 @@ public:
 	/**
 	 * Constructs a new instance of the Buddy Page Allocator.
 	 */
-	BuddyPageAllocator() {
+	BuddyPageAllocator() : _nr_free_pages(0), _reclaiming(false), _watermark_exhausted(false), _allocations_until_reclaim(0) {
 		// Iterate over each free area, and clear it.
 		for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
 			_free_areas[i] = NULL;
@@ -230,12 +284,73 @@ public:
 	}
 	
 	/**
-	 * Allocates 2^order number of contiguous pages
+	 * Asks the registered caches to give pages back.  Shrinkers free pages through this
+	 * allocator, which is safe because no free list is being modified when this is called.
+	 * Allocations made while reclaiming never trigger a nested reclaim.
+	 * @param nr_pages The number of pages to try to reclaim.
+	 * @return Returns the number of pages reclaimed.
+	 */
+	uint64_t reclaim_pages(uint64_t nr_pages)
+	{
+		if (_reclaiming) return 0;
+
+		_reclaiming = true;
+		uint64_t reclaimed = reclaim::shrink_caches(nr_pages);
+		_reclaiming = false;
+
+		return reclaimed;
+	}
+
+	/**
+	 * Allocates 2^order number of contiguous pages, reclaiming memory from caches first if
+	 * free memory is about to drop below the watermark, or if the allocation fails.
 	 * @param order The power of two, of the number of contiguous pages to allocate.
 	 * @return Returns a pointer to the first page descriptor for the newly allocated page range, or NULL if
 	 * allocation failed.
 	 */
 	PageDescriptor *alloc_pages(int order) override
+	{
+		uint64_t nr_pages = pages_per_block(order);
+
+		//Top up free memory before it runs out.  If the caches had nothing to give last time, don't
+		//ask again until free memory has recovered above the watermark.  Otherwise, while free memory
+		//stays low, only ask every RECLAIM_INTERVAL_ALLOCATIONS allocations, since each reclaim walks
+		//every cache.
+		if (!_watermark_exhausted && _nr_free_pages < LOW_WATERMARK_PAGES + nr_pages) {
+			if (_allocations_until_reclaim > 0) {
+				_allocations_until_reclaim--;
+			} else if (reclaim_pages(LOW_WATERMARK_PAGES + nr_pages - _nr_free_pages) == 0) {
+				_watermark_exhausted = true;
+			} else {
+				_allocations_until_reclaim = RECLAIM_INTERVAL_ALLOCATIONS;
+			}
+		}
+
+		PageDescriptor *pgd = allocate_block(order);
+
+		//The allocation is about to fail: count the stall, and try once more after reclaiming
+		if (pgd == NULL && !_reclaiming) {
+			reclaim::reclaim_stats.allocation_stalls++;
+
+			if (reclaim_pages(nr_pages) > 0) {
+				pgd = allocate_block(order);
+			}
+		}
+
+		if (pgd != NULL) {
+			_nr_free_pages -= nr_pages;
+		}
+
+		return pgd;
+	}
+
+	/**
+	 * Takes a block of 2^order contiguous pages off the free lists, splitting larger blocks as required.
+	 * @param order The power of two, of the number of contiguous pages to allocate.
+	 * @return Returns a pointer to the first page descriptor of the block, or NULL if there is no free block
+	 * large enough.
+	 */
+	PageDescriptor *allocate_block(int order)
 	{
 		//assert failure if order isnt under MAX_ORDER 
 		assert(order<=MAX_ORDER || order>=0);
@@ -283,6 +398,11 @@ public:
 		// illegal to free page 1 in order-1.
 		assert(is_correct_alignment_for_order(pgd, order));
 		
+		_nr_free_pages += pages_per_block(order);
+		if (_nr_free_pages >= LOW_WATERMARK_PAGES) {
+			_watermark_exhausted = false;
+			_allocations_until_reclaim = 0;
+		}
 
 		//Insert block into free area
 		PageDescriptor **block_inserted = insert_block(pgd, order);
@@ -393,6 +513,7 @@ public:
 
  					//Remove the block in 0th order to indicate that it was reserved
 					remove_block(*desired_pgd,current_order);
+					_nr_free_pages--;
 					return true;
 				}
 
@@ -489,6 +610,8 @@ public:
 
 		}
 		
+		_nr_free_pages = pages_added;
+
 		//Return True if the number of inserted pages equals with the amount of page descriptors that we were initially told that we should store
 		//Otherwise, returns false
 		return pages_added == nr_page_descriptors;
@@ -525,11 +648,23 @@ public:
 			mm_log.messagef(LogLevel::DEBUG, "%s", buffer);
 
 		}
+
+		mm_log.messagef(LogLevel::DEBUG, "free_pages=%lu reclaim_runs=%lu reclaimed_pages=%lu allocation_stalls=%lu",
+			_nr_free_pages, reclaim::reclaim_stats.reclaim_runs,
+			reclaim::reclaim_stats.reclaimed_pages, reclaim::reclaim_stats.allocation_stalls);
 	}
 
 	
 private:
 	PageDescriptor *_free_areas[MAX_ORDER+1];
+	//The number of pages currently on the free lists
+	uint64_t _nr_free_pages;
+	//Set while the shrinkers are running, so that their frees and allocations don't recurse into reclaim
+	bool _reclaiming;
+	//Set when a watermark reclaim found nothing to release
+	bool _watermark_exhausted;
+	//The number of allocations below the watermark to make before the caches are asked again
+	unsigned int _allocations_until_reclaim;
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
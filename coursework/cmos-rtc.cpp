@@ -8,6 +8,9 @@
  */
 #include <infos/drivers/timer/rtc.h>
 #include <arch/x86/pio.h>
+#include <arch/x86/x86-arch.h>
+#include <arch/x86/irq.h>
+#include <infos/kernel/device-manager.h>
 #include <infos/util/lock.h>
 #include <infos/kernel/log.h>
 #include <infos/assert.h>
@@ -27,7 +30,19 @@ seconds_offset = 0x00,
  month_offset = 0x08,
  year_offset = 0x09,
  register_a_offset = 0x0A,
- register_b_offset = 0x0B
+ register_b_offset = 0x0B,
+ register_c_offset = 0x0C
+};
+
+/**
+* Bits used to enable and identify the RTC's interrupts, and to keep NMIs disabled while a register is selected.
+* The RTC raises its interrupts on IRQ8.
+*/
+enum CMOS_INTERRUPTS{
+	update_ended_interrupt_enable = 0x10,
+	update_ended_interrupt_flag = 0x10,
+	nmi_disable = 0x80,
+	rtc_irq = 8
 };
 
 /**
@@ -110,12 +125,41 @@ class CMOSRTC : public RTC {
 public:
 	static const DeviceClass CMOSRTCDeviceClass;
 
+	CMOSRTC() : _sequence(0) { }
+
 	const DeviceClass& device_class() const override
 	{
 		return CMOSRTCDeviceClass;
 	}
 
+	/**
+	 * Initialises the RTC.  This attaches a handler to IRQ8 and enables the update-ended interrupt, so that
+	 * the current date & time is cached once a second and reading it no longer has to wait for an update cycle.
+	 * @param dm The device manager.
+	 * @return Always returns TRUE: if the interrupt cannot be attached, the RTC is polled instead.
+	 */
+	bool init(DeviceManager& dm) override
+	{
+		IRQ *irq = x86arch.irq_manager().request_physical_irq(rtc_irq, rtc_irq_handler, this);
+		if (!irq) {
+			syslog.messagef(LogLevel::WARNING, "cmos-rtc: unable to attach irq %u, polling instead", rtc_irq);
+			return true;
+		}
+
+		// The interrupt must not fire while register B is being rewritten, and NMIs are kept off while
+		// a register is selected.  Setting the update-ended interrupt enable bit (bit 4) in register B
+		// raises IRQ8 at the end of every update cycle.
+		UniqueIRQLock l;
+
+		uint8_t registerB = read_byte(register_b_offset | nmi_disable);
+		__outb(cmos_address, register_b_offset | nmi_disable);
+		__outb(cmos_data, registerB | update_ended_interrupt_enable);
 
+		// Reading register C acknowledges anything that is already pending, so that the interrupt can fire.
+		read_byte(register_c_offset);
+
+		return true;
+	}
 
 	/**
 	 * Interrogates the RTC to read the current date & time.
@@ -123,6 +167,67 @@ public:
 	 * given by the CMOS RTC device.
 	 */
 	void read_timepoint(RTCTimePoint& tp) override
+	{
+		// Once the update-ended interrupt has fired, the cached copy is at most one update old, which is as
+		// current as the RTC itself.  Until then (or if the interrupt is not available), the RTC is polled.
+		if (read_cached_timepoint(tp)) return;
+
+		poll_timepoint(tp);
+	}
+
+private:
+	/**
+	 * Copies the cached date & time, without disabling interrupts.  The cache is protected by a sequence
+	 * lock: the interrupt handler makes the sequence number odd while it writes, and even when it has
+	 * finished, so a copy is consistent if the sequence number was even and unchanged across it.
+	 * @param tp Populated with the cached date & time.
+	 * @return Returns FALSE if nothing has been cached yet.
+	 */
+	bool read_cached_timepoint(RTCTimePoint& tp) const
+	{
+		for (;;) {
+			uint32_t sequence = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+			if (sequence == 0) return false;
+
+			// A write is in progress.
+			if (sequence & 1) continue;
+
+			tp = _cached;
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&_sequence, __ATOMIC_RELAXED) == sequence) return true;
+		}
+	}
+
+	/**
+	 * Handles IRQ8.  The update-ended interrupt fires just after an update cycle has finished, when the
+	 * registers are stable for almost a second, so they can be read straight away.
+	 */
+	static void rtc_irq_handler(const IRQ *irq, void *priv)
+	{
+		CMOSRTC *rtc = (CMOSRTC *) priv;
+
+		// Reading register C acknowledges the interrupt, and tells us which of the RTC's interrupts it was.
+		uint8_t registerC = read_byte(register_c_offset);
+		if (!(registerC & update_ended_interrupt_flag)) return;
+
+		RTCTimePoint tp;
+		read_registers(tp);
+
+		__atomic_store_n(&rtc->_sequence, rtc->_sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		rtc->_cached = tp;
+
+		__atomic_store_n(&rtc->_sequence, rtc->_sequence + 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * Reads the current date & time by waiting for an update cycle to start and finish, and then reading
+	 * the registers.  This can take up to a second, with interrupts disabled.
+	 * @param tp Populated with the current date & time.
+	 */
+	static void poll_timepoint(RTCTimePoint& tp)
 	{
 		// Before accessing the RTC, we first disable the interrupts in order to be able to read the time and date safely.
 		// By safe, we mean that we can read without any process interruption and any violation.
@@ -147,6 +252,16 @@ public:
 			status_bit = get_update_in_progress_flag();
 		}
 		// Finally, once the status bit is cleared, we will start reading from RTC.
+		read_registers(tp);
+	}
+
+	/**
+	 * Reads the date & time registers, and converts them to binary, 24 hour format.  Must be called when
+	 * no update cycle is in progress.
+	 * @param tp Populated with the date & time held in the registers.
+	 */
+	static void read_registers(RTCTimePoint& tp)
+	{
 		short seconds = read_byte(seconds_offset);
 		short minutes = read_byte(minutes_offset);
 		short hours = read_byte(hours_offset);
@@ -179,9 +294,12 @@ public:
 		tp.day_of_month = day_of_month;
 		tp.month = month;
 		tp.year=year;
-	
-		
 	}
+
+	// The date & time as of the last update-ended interrupt, and the sequence number that protects it.  The
+	// sequence number is odd while the cache is being written, and zero until it has been written once.
+	RTCTimePoint _cached;
+	uint32_t _sequence;
 };
 
 const DeviceClass CMOSRTC::CMOSRTCDeviceClass(RTC::RTCDeviceClass, "cmos-rtc");
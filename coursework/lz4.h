@@ -0,0 +1,165 @@
+/*
+ * LZ4 Frame and Block Decoding
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <infos/define.h>
+#include <infos/util/string.h>
+
+// The magic number at the start of an LZ4 frame.
+#define LZ4_FRAME_MAGIC 0x184D2204
+// The largest frame header: magic, FLG, BD, content size, dictionary ID and header checksum.
+#define LZ4_MAX_FRAME_HEADER_SIZE 19
+// The bit in a block size word that marks a block as stored uncompressed.
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000U
+// The length of the shortest match.
+#define LZ4_MIN_MATCH 4
+
+namespace lz4 {
+
+	/**
+	 * The parts of an LZ4 frame descriptor that a reader needs.
+	 */
+	struct FrameInfo {
+		// The size of the frame header, i.e. the offset of the first block.
+		size_t header_size;
+		// The largest size a block decompresses to.  Every block but the last is exactly this size.
+		size_t block_max_size;
+		// Whether each block is followed by a 32-bit checksum.
+		bool block_checksums;
+		// The decompressed size of the whole frame, if the frame records it.
+		bool has_content_size;
+		uint64_t content_size;
+	};
+
+	static inline uint32_t read_le32(const uint8_t *data)
+	{
+		return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+	}
+
+	/**
+	 * Parses the header of an LZ4 frame.  Only frames with independent blocks are accepted,
+	 * since a block that refers back into the previous one cannot be decoded on its own, and
+	 * so could not be read without decoding everything before it.
+	 * @param data The start of the frame.
+	 * @param len The number of valid bytes in data, which should be LZ4_MAX_FRAME_HEADER_SIZE.
+	 * @param info Receives the frame parameters.
+	 * @return Returns FALSE if this is not an LZ4 frame, or it is one that cannot be read.
+	 */
+	static inline bool parse_frame_header(const uint8_t *data, size_t len, FrameInfo& info)
+	{
+		if (len < 7 || read_le32(data) != LZ4_FRAME_MAGIC) return false;
+
+		uint8_t flags = data[4], block_descriptor = data[5];
+
+		// Version 01, with independent blocks.
+		if ((flags >> 6) != 1 || !(flags & 0x20)) return false;
+
+		unsigned int block_size_id = (block_descriptor >> 4) & 7;
+		if (block_size_id < 4) return false;
+
+		info.block_max_size = (size_t) 1 << (8 + (2 * block_size_id));
+		info.block_checksums = (flags & 0x10) != 0;
+		info.has_content_size = (flags & 0x08) != 0;
+		info.content_size = 0;
+
+		size_t pos = 6;
+		if (info.has_content_size) {
+			if (len < pos + 8 + 1) return false;
+
+			info.content_size = (uint64_t) read_le32(&data[pos]) | ((uint64_t) read_le32(&data[pos + 4]) << 32);
+			pos += 8;
+		}
+
+		// Frames that need a dictionary are not supported.
+		if (flags & 0x01) return false;
+
+		// The header checksum byte follows.
+		info.header_size = pos + 1;
+		return len >= info.header_size;
+	}
+
+	/**
+	 * Reads a length that continues into extra bytes: while a byte is 255, the next one adds on too.
+	 * @return Returns FALSE if the input ran out first.
+	 */
+	static inline bool read_length(const uint8_t *& ip, const uint8_t *iend, size_t& length)
+	{
+		uint8_t byte;
+
+		do {
+			if (ip >= iend) return false;
+
+			byte = *ip++;
+			length += byte;
+		} while (byte == 255);
+
+		return true;
+	}
+
+	/**
+	 * Decompresses one LZ4 block.  Every length and offset is checked against the input and
+	 * output buffers, so a corrupt block is rejected rather than read or written out of bounds.
+	 * @param src The compressed block.
+	 * @param src_size The size of the compressed block.
+	 * @param dst The buffer to decompress into.
+	 * @param dst_capacity The size of the output buffer.
+	 * @return Returns the decompressed size, or -1 if the block is malformed or does not fit.
+	 */
+	static inline long decompress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity)
+	{
+		const uint8_t *ip = src, *iend = src + src_size;
+		uint8_t *op = dst, *oend = dst + dst_capacity;
+
+		while (ip < iend) {
+			// Each sequence starts with a token: the literal length, and the match length.
+			uint8_t token = *ip++;
+
+			size_t literals = token >> 4;
+			if (literals == 15 && !read_length(ip, iend, literals)) return -1;
+
+			if (literals > (size_t) (iend - ip) || literals > (size_t) (oend - op)) return -1;
+
+			memcpy(op, ip, literals);
+			ip += literals;
+			op += literals;
+
+			// The last sequence has literals only.
+			if (ip == iend) break;
+
+			if (iend - ip < 2) return -1;
+			size_t offset = ip[0] | ((size_t) ip[1] << 8);
+			ip += 2;
+
+			if (offset == 0 || offset > (size_t) (op - dst)) return -1;
+
+			size_t match = token & 15;
+			if (match == 15 && !read_length(ip, iend, match)) return -1;
+			match += LZ4_MIN_MATCH;
+
+			if (match > (size_t) (oend - op)) return -1;
+
+			// A match that starts close behind the output overlaps what it produces, and repeats
+			// it, so only a match at least its own length back can be copied in one go.
+			const uint8_t *from = op - offset;
+			if (offset >= match) {
+				memcpy(op, from, match);
+			} else {
+				for (size_t i = 0; i < match; i++) {
+					op[i] = from[i];
+				}
+			}
+
+			op += match;
+		}
+
+		return op - dst;
+	}
+}
+
+#endif /* LZ4_H */
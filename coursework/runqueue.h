@@ -0,0 +1,448 @@
+/*
+ * Scheduler Runqueue Helpers
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef RUNQUEUE_H
+#define RUNQUEUE_H
+
+#include <infos/kernel/sched.h>
+
+// The number of buckets in an entity table.  Must be a power of two.
+#define RUNQUEUE_NR_BUCKETS 256
+// The number of nodes an entity table allocates at a time, when its pool runs dry.
+#define RUNQUEUE_NODE_BATCH 32
+// The capacity of a wakeup queue.  Must be a power of two.
+#define RUNQUEUE_WAKEUP_SLOTS 256
+
+namespace runqueue {
+
+	/**
+	 * The per-entity bookkeeping a scheduler keeps for an entity on its runqueue.  A node
+	 * is linked into a ring (the runqueue itself) and into a hash chain (for lookup by
+	 * entity), so neither adding, removing nor rotating needs to search or allocate.
+	 */
+	struct RunqueueNode {
+		infos::kernel::SchedulingEntity *entity;
+		RunqueueNode *next, *prev;
+		RunqueueNode *hash_next;
+
+		// Policy state: the queue level the node is on, and the ticks it has used there.
+		unsigned int level;
+		unsigned int ticks;
+
+		// Policy state for heap-ordered policies: the value the heap is ordered on, the
+		// node's position in the heap (or slot in a timer wheel), the entity's weight, and
+		// any further state the policy keeps for the entity.
+		uint64_t key;
+		unsigned int heap_index;
+		uint64_t weight;
+		void *policy;
+
+		// Statistics: when the entity last became ready to run, when it last started
+		// running, the total time it has spent waiting, and how many times it has run.
+		uint64_t ready_since, run_start, wait_total;
+		unsigned int nr_runs;
+	};
+
+	/**
+	 * Maps scheduling entities to their runqueue nodes.  Nodes come from a pool that is
+	 * only topped up when it runs dry, so in the steady state inserting and erasing never
+	 * allocate.  The table does not lock: callers hold the runqueue lock.
+	 *
+	 * The runqueue lock is a UniqueIRQLock, which only excludes the local CPU.  That is
+	 * sufficient because the kernel drives each scheduling algorithm from a single CPU;
+	 * it would not be if runqueues were ever shared between CPUs.
+	 */
+	class EntityTable {
+	public:
+		EntityTable() : _free_nodes(NULL), _count(0) {
+			for (unsigned int i = 0; i < RUNQUEUE_NR_BUCKETS; i++) {
+				_buckets[i] = NULL;
+			}
+		}
+
+		/**
+		 * Returns the node for the given entity, or NULL if the entity is not in the table.
+		 */
+		RunqueueNode *lookup(const infos::kernel::SchedulingEntity *entity) const {
+			for (RunqueueNode *node = _buckets[bucket_of(entity)]; node != NULL; node = node->hash_next) {
+				if (node->entity == entity) return node;
+			}
+
+			return NULL;
+		}
+
+		/**
+		 * Creates a node for the given entity, which must not already be in the table.
+		 */
+		RunqueueNode *insert(infos::kernel::SchedulingEntity *entity) {
+			if (_free_nodes == NULL) {
+				refill_pool();
+			}
+
+			RunqueueNode *node = _free_nodes;
+			_free_nodes = node->hash_next;
+
+			node->entity = entity;
+			node->next = node->prev = NULL;
+			node->level = 0;
+			node->ticks = 0;
+			node->key = 0;
+			node->heap_index = 0;
+			node->weight = 0;
+			node->policy = NULL;
+			node->ready_since = node->run_start = node->wait_total = 0;
+			node->nr_runs = 0;
+
+			unsigned int bucket = bucket_of(entity);
+			node->hash_next = _buckets[bucket];
+			_buckets[bucket] = node;
+
+			_count++;
+			return node;
+		}
+
+		/**
+		 * Removes a node from the table, and returns it to the pool.
+		 */
+		void erase(RunqueueNode *node) {
+			RunqueueNode **slot = &_buckets[bucket_of(node->entity)];
+			while (*slot != node) {
+				slot = &(*slot)->hash_next;
+			}
+
+			*slot = node->hash_next;
+
+			node->entity = NULL;
+			node->hash_next = _free_nodes;
+			_free_nodes = node;
+
+			_count--;
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+	private:
+		static unsigned int bucket_of(const infos::kernel::SchedulingEntity *entity) {
+			// Entities are heap objects, so the low bits carry little information.
+			uint64_t value = (uint64_t) entity;
+			return ((value >> 4) ^ (value >> 12)) & (RUNQUEUE_NR_BUCKETS - 1);
+		}
+
+		void refill_pool() {
+			RunqueueNode *nodes = new RunqueueNode[RUNQUEUE_NODE_BATCH];
+
+			for (unsigned int i = 0; i < RUNQUEUE_NODE_BATCH; i++) {
+				nodes[i].hash_next = _free_nodes;
+				_free_nodes = &nodes[i];
+			}
+		}
+
+		RunqueueNode *_buckets[RUNQUEUE_NR_BUCKETS];
+		RunqueueNode *_free_nodes;
+		unsigned int _count;
+	};
+
+	/**
+	 * A circular, doubly-linked runqueue of nodes.  The head is the next node to run, and
+	 * the node before it is the tail, so enqueueing at the tail, removing any node, and
+	 * rotating the head to the back of the queue are all constant-time pointer updates.
+	 */
+	class RunqueueRing {
+	public:
+		RunqueueRing() : _head(NULL), _count(0) { }
+
+		/**
+		 * Adds a node to the back of the queue.
+		 */
+		void enqueue(RunqueueNode *node) {
+			if (_head == NULL) {
+				node->next = node->prev = node;
+				_head = node;
+			} else {
+				node->next = _head;
+				node->prev = _head->prev;
+				_head->prev->next = node;
+				_head->prev = node;
+			}
+
+			_count++;
+		}
+
+		/**
+		 * Adds a node to the front of the queue, so that it is the next node to run.
+		 */
+		void push_front(RunqueueNode *node) {
+			enqueue(node);
+			_head = node;
+		}
+
+		/**
+		 * Adds a node to the queue directly after another node that is on it.
+		 */
+		void insert_after(RunqueueNode *position, RunqueueNode *node) {
+			node->prev = position;
+			node->next = position->next;
+			position->next->prev = node;
+			position->next = node;
+
+			_count++;
+		}
+
+		/**
+		 * Removes a node from the queue.
+		 */
+		void remove(RunqueueNode *node) {
+			if (node->next == node) {
+				_head = NULL;
+			} else {
+				node->prev->next = node->next;
+				node->next->prev = node->prev;
+
+				if (_head == node) {
+					_head = node->next;
+				}
+			}
+
+			node->next = node->prev = NULL;
+			_count--;
+		}
+
+		/**
+		 * Moves the head of the queue to the back of the queue.
+		 */
+		void rotate() {
+			if (_head != NULL) {
+				_head = _head->next;
+			}
+		}
+
+		RunqueueNode *head() const {
+			return _head;
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+		bool empty() const {
+			return _head == NULL;
+		}
+
+	private:
+		RunqueueNode *_head;
+		unsigned int _count;
+	};
+
+	/**
+	 * A binary min-heap of nodes, ordered on their key.  Each node records its own position
+	 * in the heap, so any node can be removed, or re-positioned after its key changes, in
+	 * O(log n) without searching.  The backing array doubles when it fills, so in the steady
+	 * state the heap does not allocate.
+	 */
+	class NodeHeap {
+	public:
+		NodeHeap() : _nodes(NULL), _count(0), _capacity(0) { }
+
+		void push(RunqueueNode *node) {
+			if (_count == _capacity) {
+				grow();
+			}
+
+			node->heap_index = _count;
+			_nodes[_count++] = node;
+
+			sift_up(node->heap_index);
+		}
+
+		void remove(RunqueueNode *node) {
+			unsigned int index = node->heap_index;
+			RunqueueNode *last = _nodes[--_count];
+
+			if (index != _count) {
+				place(last, index);
+				update(last);
+			}
+		}
+
+		/**
+		 * Restores the heap order after the key of a node has changed.
+		 */
+		void update(RunqueueNode *node) {
+			sift_up(node->heap_index);
+			sift_down(node->heap_index);
+		}
+
+		RunqueueNode *top() const {
+			return _count == 0 ? NULL : _nodes[0];
+		}
+
+		/**
+		 * Returns the node at a position in the heap's array, for walking every node in no particular order.
+		 */
+		RunqueueNode *at(unsigned int index) const {
+			return _nodes[index];
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+		bool empty() const {
+			return _count == 0;
+		}
+
+	private:
+		void place(RunqueueNode *node, unsigned int index) {
+			_nodes[index] = node;
+			node->heap_index = index;
+		}
+
+		void sift_up(unsigned int index) {
+			RunqueueNode *node = _nodes[index];
+
+			while (index > 0) {
+				unsigned int parent = (index - 1) / 2;
+				if (_nodes[parent]->key <= node->key) break;
+
+				place(_nodes[parent], index);
+				index = parent;
+			}
+
+			place(node, index);
+		}
+
+		void sift_down(unsigned int index) {
+			RunqueueNode *node = _nodes[index];
+
+			for (;;) {
+				unsigned int child = (2 * index) + 1;
+				if (child >= _count) break;
+
+				if (child + 1 < _count && _nodes[child + 1]->key < _nodes[child]->key) child++;
+				if (node->key <= _nodes[child]->key) break;
+
+				place(_nodes[child], index);
+				index = child;
+			}
+
+			place(node, index);
+		}
+
+		void grow() {
+			unsigned int capacity = _capacity == 0 ? RUNQUEUE_NODE_BATCH : _capacity * 2;
+			RunqueueNode **nodes = new RunqueueNode *[capacity];
+
+			for (unsigned int i = 0; i < _count; i++) {
+				nodes[i] = _nodes[i];
+			}
+
+			if (_nodes != NULL) delete[] _nodes;
+
+			_nodes = nodes;
+			_capacity = capacity;
+		}
+
+		RunqueueNode **_nodes;
+		unsigned int _count, _capacity;
+	};
+
+	/**
+	 * A bounded, lock-free, multiple-producer single-consumer queue of entities that have
+	 * become runnable.  Pushing takes no lock and does not allocate, so wakeups (including
+	 * those from interrupt handlers) never disable interrupts; the scheduler drains the queue
+	 * in a batch, with the runqueue lock held.
+	 *
+	 * Each slot carries a sequence number.  A producer claims a slot by advancing the tail
+	 * with a compare-and-swap, fills it in, and then publishes it by bumping its sequence
+	 * number.  The consumer only takes slots that have been published, so a producer that is
+	 * interrupted half way through simply has its entry taken by a later drain.
+	 */
+	class WakeupQueue {
+	public:
+		WakeupQueue() : _head(0), _tail(0) {
+			for (unsigned int i = 0; i < RUNQUEUE_WAKEUP_SLOTS; i++) {
+				_slots[i].sequence = i;
+			}
+		}
+
+		/**
+		 * Pushes an entity onto the queue.  Safe to call from any context.
+		 * @param entity The entity that has become runnable.
+		 * @param ready_since The time at which it became runnable.
+		 * @return Returns FALSE if the queue is full, in which case the caller must add
+		 * the entity to the runqueue itself.
+		 */
+		bool push(infos::kernel::SchedulingEntity *entity, uint64_t ready_since) {
+			uint64_t pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+			Slot *slot;
+
+			for (;;) {
+				slot = &_slots[pos & (RUNQUEUE_WAKEUP_SLOTS - 1)];
+				int64_t diff = (int64_t) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+
+				if (diff == 0) {
+					// The slot is free: try to claim it.  On failure, pos is reloaded with the current tail.
+					if (__atomic_compare_exchange_n(&_tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+				} else if (diff < 0) {
+					// The slot still holds an entry from a full lap ago: the queue is full.
+					return false;
+				} else {
+					// Another producer claimed this slot first.
+					pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+				}
+			}
+
+			slot->entity = entity;
+			slot->ready_since = ready_since;
+			__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+			return true;
+		}
+
+		/**
+		 * Takes the oldest published entity off the queue.  Only one consumer may call this
+		 * at a time, which the runqueue lock guarantees.
+		 * @return Returns FALSE if there is nothing (yet) to take.
+		 */
+		bool pop(infos::kernel::SchedulingEntity *& entity, uint64_t& ready_since) {
+			Slot *slot = &_slots[_head & (RUNQUEUE_WAKEUP_SLOTS - 1)];
+
+			if ((int64_t) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (_head + 1)) < 0) return false;
+
+			entity = slot->entity;
+			ready_since = slot->ready_since;
+
+			// Hand the slot back to the producers, for the next lap.
+			__atomic_store_n(&slot->sequence, _head + RUNQUEUE_WAKEUP_SLOTS, __ATOMIC_RELEASE);
+			_head++;
+
+			return true;
+		}
+
+		/**
+		 * Returns TRUE if an entity has been pushed (or is being pushed) and not yet taken
+		 * off the queue.  Safe to call from any context.
+		 */
+		bool pending() const {
+			return __atomic_load_n(&_tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&_head, __ATOMIC_RELAXED);
+		}
+
+	private:
+		struct Slot {
+			uint64_t sequence;
+			infos::kernel::SchedulingEntity *entity;
+			uint64_t ready_since;
+		};
+
+		Slot _slots[RUNQUEUE_WAKEUP_SLOTS];
+		uint64_t _head, _tail;
+	};
+}
+
+#endif /* RUNQUEUE_H */
@@ -0,0 +1,692 @@
+/*
+ * Earliest-Deadline-First Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "runqueue.h"
+#include "sched-entity.h"
+#include "sched-params.h"
+#include "sched-stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace runqueue;
+
+// Fixed-point scale used for bandwidths, i.e. runtime / period.
+#define EDF_BANDWIDTH_SCALE (1UL << 20)
+// The share of the CPU that reservations may claim in total.  The rest is left for
+// entities without a reservation.
+#define EDF_MAX_BANDWIDTH ((EDF_BANDWIDTH_SCALE * 95) / 100)
+// The number of reservation classes.  An entity's class is its priority, and any beyond the last class share it.
+#define EDF_NR_CLASSES 8
+// The most reservations that can be admitted at once.  They are preallocated, so that admitting
+// and releasing them never allocates with the runqueue lock held.
+#define EDF_MAX_RESERVATIONS 64
+
+// Where a node is, kept in its level: on the background ring, on the deadline heap, throttled
+// until its budget is replenished, or held for an entity that is asleep.
+#define EDF_BACKGROUND 0
+#define EDF_READY 1
+#define EDF_THROTTLED 2
+#define EDF_HELD 3
+
+/**
+ * The reservation every entity of a class is given, in kernel runtime ticks.  A class with no
+ * runtime gives no reservation.
+ */
+struct EDFClassParameters {
+	uint64_t runtime, deadline, period;
+};
+
+// The reservation parameters of each class, set from the kernel command line.
+static EDFClassParameters edf_class_parameters[EDF_NR_CLASSES];
+
+/**
+ * sched.edf.reserve=<class>:<runtime>:<deadline>:<period>,... gives each entity of the listed
+ * classes a reservation of 'runtime' ticks in every 'period', to be used by 'deadline' ticks
+ * into the period, where 0 < runtime <= deadline <= period.  Each entity is admitted on its
+ * own, when it becomes runnable.
+ */
+RegisterCmdLineArgument(EDFReserve, "sched.edf.reserve")
+{
+	const char *p = value;
+	uint64_t values[4];
+	int nr_values;
+
+	while ((nr_values = sched_params::read_entry(p, values, 4)) > 0) {
+		if (nr_values != 4 || values[0] >= EDF_NR_CLASSES || values[1] == 0 || values[1] > values[2] || values[2] > values[3]) {
+			nr_values = -1;
+			break;
+		}
+
+		EDFClassParameters& parameters = edf_class_parameters[values[0]];
+		parameters.runtime = values[1];
+		parameters.deadline = values[2];
+		parameters.period = values[3];
+	}
+
+	if (nr_values < 0) {
+		syslog.messagef(LogLevel::WARNING, "edf: sched.edf.reserve=%s is malformed, and was only applied up to '%s'", value, p);
+	}
+}
+
+/**
+ * An earliest-deadline-first scheduling algorithm, with constant-bandwidth servers.
+ *
+ * Entities with a reservation get up to 'runtime' ticks of CPU in every 'period', and are
+ * kept in a heap ordered on their absolute deadline, so the one with the earliest deadline
+ * runs.  Each reservation is a hard constant-bandwidth server: when its budget runs out, it
+ * is throttled until its next period starts, so an entity that overruns only eats into its
+ * own share, and entities without a reservation run round-robin in the time left over.
+ *
+ * An entity is given its own reservation with set_parameters() (see sched-entity.h), with
+ * the values { runtime, deadline, period }.  It is admitted straight away, or rejected, as
+ * long as the total bandwidth stays within EDF_MAX_BANDWIDTH, and is kept while the entity
+ * sleeps, until it exits.  Entities without one get the reservation of their class (see
+ * sched.edf.reserve), admitted when they become runnable; an entity that is not admitted
+ * runs in the background.  When an entity leaves the runqueue, a class reservation is held
+ * until the end of its current period, so that an entity that wakes up within the period
+ * carries on with its budget and deadline.  After that the bandwidth is released, since the
+ * wakeup rule would start the entity on a fresh period anyway.
+ *
+ * All times are in kernel runtime ticks.
+ */
+class EDFScheduler : public SchedulingAlgorithm, public sched_entity::EntityParameters
+{
+public:
+	EDFScheduler() : stats("edf"), _current(NULL), _last_pick(0), _free_reservations(NULL), _total_bandwidth(0), _nr_reservations(0),
+		_deadline_misses(0), _admission_failures(0)
+	{
+		for (unsigned int i = 0; i < EDF_MAX_RESERVATIONS; i++) {
+			_reservation_pool[i].next_free = _free_reservations;
+			_free_reservations = &_reservation_pool[i];
+		}
+
+		sched_entity::register_entity_parameters(*this, *this);
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "edf"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		//Wakeups go onto a lock-free queue, and join the runqueue when the queue is next drained
+		uint64_t now = sys.runtime_ticks();
+		if (wakeups.push(&entity, now)) return;
+
+		UniqueIRQLock l;
+		enqueue_entity(entity, now);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *node = entities.lookup(&entity);
+		if (!node) return;
+
+		//Charge a reserved entity for the time it ran, so that its budget carries over to its next wakeup
+		uint64_t now = sys.runtime_ticks();
+		if (_current == node) {
+			charge(node, now);
+			_current = NULL;
+		}
+
+		Reservation *reservation = (Reservation *) node->policy;
+
+		dequeue(node);
+		stats.entity_removed(node);
+		entities.erase(node);
+
+		//An entity's own reservation stays with it while it sleeps
+		if (reservation != NULL && !reservation->own) hold(entity, reservation, now);
+	}
+
+	/**
+	 * Sets the parameters of an entity: { runtime, deadline, period }, in kernel runtime ticks.
+	 */
+	bool set_parameters(SchedulingEntity& entity, const uint64_t *values, unsigned int count) override
+	{
+		if (count == 0) return set_parameters(entity, 0, 0, 0);
+		if (count != 3) return false;
+
+		return set_parameters(entity, values[0], values[1], values[2]);
+	}
+
+	/**
+	 * Gives an entity a reservation of its own, of 'runtime' ticks in every 'period', to be used by
+	 * 'deadline' ticks into the period, where 0 < runtime <= deadline <= period.  It is admitted as
+	 * long as the total bandwidth, less whatever reservation the entity had, stays within
+	 * EDF_MAX_BANDWIDTH.  A runtime of zero takes the entity's own reservation away.
+	 * @return Returns FALSE if the parameters are malformed or the reservation is not admitted, in
+	 * which case the entity keeps the reservation it had.
+	 */
+	bool set_parameters(SchedulingEntity& entity, uint64_t runtime, uint64_t deadline, uint64_t period)
+	{
+		if (runtime != 0 && (runtime > deadline || deadline > period)) return false;
+
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *node = entities.lookup(&entity);
+		RunqueueNode *own = own_reservations.lookup(&entity);
+		Reservation *old = node ? (Reservation *) node->policy : own ? (Reservation *) own->policy : NULL;
+
+		Reservation *reservation = NULL;
+		if (runtime != 0) {
+			uint64_t bandwidth = (runtime * EDF_BANDWIDTH_SCALE) / period;
+			RunqueueNode *held_node = held_entities.lookup(&entity);
+			uint64_t freed = (old ? old->bandwidth : 0) + (held_node ? ((Reservation *) held_node->policy)->bandwidth : 0);
+
+			if (_total_bandwidth - freed + bandwidth > EDF_MAX_BANDWIDTH || (reservation = admit(runtime, deadline, period, bandwidth)) == NULL) {
+				_admission_failures++;
+				return false;
+			}
+
+			reservation->own = true;
+		} else if (own == NULL) {
+			return true;
+		}
+
+		//A class reservation held while the entity slept is given up, as well as whatever it had
+		drop_held(entity);
+
+		uint64_t now = sys.runtime_ticks();
+		if (node) {
+			if (_current == node) charge(node, now);
+			dequeue(node);
+		}
+
+		if (old != NULL) release(old);
+
+		if (reservation != NULL) {
+			if (own == NULL) own = own_reservations.insert(&entity);
+			own->policy = reservation;
+		} else {
+			own_reservations.erase(own);
+		}
+
+		//A runnable entity is scheduled with its new reservation, or without one, that of its class
+		if (node) {
+			node->policy = reservation != NULL ? reservation : reservation_for(entity);
+			enqueue(node, now);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Releases every reservation an entity has: its own, or one of its class held while it slept.
+	 */
+	void entity_exited(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		drain_wakeups();
+
+		//The entity should have left the runqueue already, but make sure nothing refers to it
+		RunqueueNode *node = entities.lookup(&entity);
+		if (node) {
+			Reservation *reservation = (Reservation *) node->policy;
+
+			if (_current == node) _current = NULL;
+			dequeue(node);
+			stats.entity_removed(node);
+			entities.erase(node);
+
+			if (reservation != NULL && !reservation->own) release(reservation);
+		}
+
+		drop_held(entity);
+
+		RunqueueNode *own = own_reservations.lookup(&entity);
+		if (own) {
+			release((Reservation *) own->policy);
+			own_reservations.erase(own);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		SchedulingEntity *next;
+
+		{
+			UniqueIRQLock l;
+			stats.pick_started();
+
+			drain_wakeups();
+
+			uint64_t now = sys.runtime_ticks();
+
+			//Charge the entity that was running for the time since the last pick
+			if (_current != NULL) {
+				charge(_current, now);
+			}
+
+			//Throttled servers whose next period has started get a full budget, and compete again
+			while (!throttled.empty() && throttled.top()->key <= now) {
+				RunqueueNode *node = throttled.top();
+				Reservation *reservation = (Reservation *) node->policy;
+
+				throttled.remove(node);
+
+				reservation->abs_deadline = node->key + reservation->deadline;
+				reservation->budget = reservation->runtime;
+				make_ready(node);
+			}
+
+			//A reserved entity that is still runnable when its deadline arrives has missed it.  Count the
+			//miss and start it on a fresh period, so one overrun doesn't cascade into the next.
+			while (!deadlines.empty() && deadlines.top()->key <= now) {
+				RunqueueNode *node = deadlines.top();
+				Reservation *reservation = (Reservation *) node->policy;
+
+				reservation->misses++;
+				_deadline_misses++;
+
+				replenish(node, now);
+			}
+
+			//Reservations held for sleeping entities are released once their period is over
+			while (!held.empty() && held.top()->key <= now) {
+				RunqueueNode *node = held.top();
+
+				held.remove(node);
+				release((Reservation *) node->policy);
+				held_entities.erase(node);
+			}
+
+			//The earliest deadline runs.  Without any runnable reservation, the background entities take turns.
+			if (!deadlines.empty()) {
+				_current = deadlines.top();
+			} else {
+				_current = background.head();
+				background.rotate();
+			}
+
+			_last_pick = now;
+
+			stats.entity_picked(_current, entities.count());
+			if (stats.dump_due()) {
+				stats.snapshot();
+				stats.snapshot_policy("reservations=%u bandwidth=%lu/%lu deadline_misses=%lu admission_failures=%lu throttled=%u held=%u",
+					_nr_reservations, _total_bandwidth, EDF_BANDWIDTH_SCALE, _deadline_misses, _admission_failures,
+					throttled.count(), held.count());
+				snapshot_reservations(deadlines);
+				snapshot_reservations(throttled);
+				snapshot_reservations(held);
+				stats.snapshot_entities(&background, 1);
+			}
+
+			next = _current == NULL ? NULL : _current->entity;
+		}
+
+		//Any statistics due are logged once the runqueue lock is released.
+		stats.flush();
+		return next;
+	}
+
+private:
+	/**
+	 * A real-time reservation: the parameters that were admitted, and the state of its
+	 * constant-bandwidth server.  A reservation belongs to the node of its entity, which is
+	 * on the runqueue while the entity is runnable.  While the entity sleeps, a class
+	 * reservation is held, and the entity's own reservation is kept in own_reservations.
+	 */
+	struct Reservation {
+		unsigned int cls;
+		bool own;
+		uint64_t runtime, deadline, period;
+		uint64_t bandwidth;
+
+		// The runtime left in the current period, and the absolute deadline of the current period.
+		uint64_t budget, abs_deadline;
+
+		uint64_t misses;
+
+		// The next reservation in the pool, while this one is free.
+		Reservation *next_free;
+	};
+
+	/**
+	 * Adds a newly runnable entity.  Must be called with the runqueue lock held.
+	 */
+	void enqueue_entity(SchedulingEntity& entity, uint64_t ready_since)
+	{
+		//An entity is only ever queued once
+		if (entities.lookup(&entity)) return;
+
+		RunqueueNode *node = entities.insert(&entity);
+		node->policy = reservation_for(entity);
+
+		enqueue(node, ready_since);
+		stats.entity_enqueued(node, ready_since);
+	}
+
+	/**
+	 * Moves every entity waiting in the wakeup queue onto the runqueue, in the order they woke up.
+	 * Must be called with the runqueue lock held.
+	 */
+	void drain_wakeups()
+	{
+		SchedulingEntity *entity;
+		uint64_t ready_since;
+
+		while (wakeups.pop(entity, ready_since)) {
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	/**
+	 * Returns the reservation for an entity that is becoming runnable: its own, or the one held
+	 * for it since it went to sleep, or a newly admitted one, or NULL if its class has no
+	 * reservation or there is not enough bandwidth left.
+	 */
+	Reservation *reservation_for(SchedulingEntity& entity)
+	{
+		RunqueueNode *own = own_reservations.lookup(&entity);
+		if (own) return (Reservation *) own->policy;
+
+		unsigned int cls = class_of(entity);
+		Reservation *reservation = NULL;
+
+		RunqueueNode *node = held_entities.lookup(&entity);
+		if (node) {
+			reservation = (Reservation *) node->policy;
+
+			held.remove(node);
+			held_entities.erase(node);
+
+			//The entity has changed class since (or is a new entity in the old one's place)
+			if (reservation->cls != cls) {
+				release(reservation);
+				reservation = NULL;
+			}
+		}
+
+		if (reservation != NULL) return reservation;
+
+		const EDFClassParameters& parameters = edf_class_parameters[cls];
+		if (parameters.runtime == 0) return NULL;
+
+		uint64_t bandwidth = (parameters.runtime * EDF_BANDWIDTH_SCALE) / parameters.period;
+		if (_total_bandwidth + bandwidth > EDF_MAX_BANDWIDTH ||
+			(reservation = admit(parameters.runtime, parameters.deadline, parameters.period, bandwidth)) == NULL) {
+			_admission_failures++;
+			return NULL;
+		}
+
+		reservation->cls = cls;
+		return reservation;
+	}
+
+	/**
+	 * Takes a reservation from the pool, and claims its bandwidth.  The caller has checked that
+	 * the bandwidth fits.
+	 * @return Returns the reservation, or NULL if every reservation in the pool is in use.
+	 */
+	Reservation *admit(uint64_t runtime, uint64_t deadline, uint64_t period, uint64_t bandwidth)
+	{
+		Reservation *reservation = _free_reservations;
+		if (reservation == NULL) return NULL;
+
+		_free_reservations = reservation->next_free;
+
+		reservation->cls = 0;
+		reservation->own = false;
+		reservation->runtime = runtime;
+		reservation->deadline = deadline;
+		reservation->period = period;
+		reservation->bandwidth = bandwidth;
+		reservation->budget = runtime;
+		reservation->abs_deadline = 0;
+		reservation->misses = 0;
+
+		_total_bandwidth += bandwidth;
+		_nr_reservations++;
+
+		return reservation;
+	}
+
+	/**
+	 * Holds the reservation of an entity that has left the runqueue until the end of its current
+	 * period, or releases it straight away if that has passed.
+	 */
+	void hold(SchedulingEntity& entity, Reservation *reservation, uint64_t now)
+	{
+		uint64_t end = period_end(reservation);
+		if (end <= now) {
+			release(reservation);
+			return;
+		}
+
+		RunqueueNode *node = held_entities.insert(&entity);
+		node->policy = reservation;
+		node->level = EDF_HELD;
+		node->key = end;
+		held.push(node);
+	}
+
+	/**
+	 * Releases the class reservation held for a sleeping entity, if there is one.
+	 */
+	void drop_held(SchedulingEntity& entity)
+	{
+		RunqueueNode *node = held_entities.lookup(&entity);
+		if (!node) return;
+
+		held.remove(node);
+		release((Reservation *) node->policy);
+		held_entities.erase(node);
+	}
+
+	/**
+	 * Gives a reservation's bandwidth back, and returns it to the pool.
+	 */
+	void release(Reservation *reservation)
+	{
+		_total_bandwidth -= reservation->bandwidth;
+		_nr_reservations--;
+
+		reservation->next_free = _free_reservations;
+		_free_reservations = reservation;
+	}
+
+	/**
+	 * Places a node on the deadline heap if its entity has a reservation, or on the background
+	 * ring otherwise.  On wakeup, a reservation keeps its current deadline and budget only if
+	 * using that budget before that deadline would stay within its bandwidth (the CBS wakeup
+	 * rule); otherwise it starts a fresh period.  A reservation that has used up its budget
+	 * stays throttled until its next period.
+	 */
+	void enqueue(RunqueueNode *node, uint64_t now)
+	{
+		Reservation *reservation = (Reservation *) node->policy;
+
+		if (reservation == NULL) {
+			node->level = EDF_BACKGROUND;
+			background.enqueue(node);
+			return;
+		}
+
+		if (reservation->budget == 0 && period_end(reservation) > now) {
+			throttle(node);
+			return;
+		}
+
+		if (reservation->budget == 0 || reservation->abs_deadline <= now ||
+			reservation->budget * reservation->period > (reservation->abs_deadline - now) * reservation->runtime) {
+			reservation->abs_deadline = now + reservation->deadline;
+			reservation->budget = reservation->runtime;
+		}
+
+		make_ready(node);
+	}
+
+	void dequeue(RunqueueNode *node)
+	{
+		switch (node->level) {
+		case EDF_READY:
+			deadlines.remove(node);
+			break;
+
+		case EDF_THROTTLED:
+			throttled.remove(node);
+			break;
+
+		default:
+			background.remove(node);
+			break;
+		}
+	}
+
+	/**
+	 * Puts a reserved node on the deadline heap, at its reservation's deadline.
+	 */
+	void make_ready(RunqueueNode *node)
+	{
+		Reservation *reservation = (Reservation *) node->policy;
+
+		node->level = EDF_READY;
+		node->key = reservation->abs_deadline;
+		deadlines.push(node);
+	}
+
+	/**
+	 * Puts a reserved node aside until its reservation's next period starts.
+	 */
+	void throttle(RunqueueNode *node)
+	{
+		node->level = EDF_THROTTLED;
+		node->key = period_end((Reservation *) node->policy);
+		throttled.push(node);
+	}
+
+	/**
+	 * Charges a reserved entity for the time it has run since the last pick.  When its budget
+	 * runs out, the server is throttled until its next period.
+	 */
+	void charge(RunqueueNode *node, uint64_t now)
+	{
+		Reservation *reservation = (Reservation *) node->policy;
+		if (reservation == NULL) return;
+
+		uint64_t ran = now - _last_pick;
+		reservation->budget = ran >= reservation->budget ? 0 : reservation->budget - ran;
+		_last_pick = now;
+
+		if (reservation->budget == 0 && node->level == EDF_READY) {
+			deadlines.remove(node);
+			throttle(node);
+		}
+	}
+
+	/**
+	 * Starts a reserved entity on a fresh period, beginning now.
+	 */
+	void replenish(RunqueueNode *node, uint64_t now)
+	{
+		Reservation *reservation = (Reservation *) node->policy;
+
+		reservation->abs_deadline = now + reservation->deadline;
+		reservation->budget = reservation->runtime;
+
+		node->key = reservation->abs_deadline;
+		deadlines.update(node);
+	}
+
+	/**
+	 * Adds the reserved nodes on a heap to the statistics snapshot, with their deadline misses.
+	 */
+	void snapshot_reservations(const NodeHeap& heap)
+	{
+		for (unsigned int i = 0; i < heap.count(); i++) {
+			RunqueueNode *node = heap.at(i);
+			stats.snapshot_entity(node, ((Reservation *) node->policy)->misses);
+		}
+	}
+
+	/**
+	 * Returns the time at which the current period of a reservation ends, and the next starts.
+	 */
+	static uint64_t period_end(const Reservation *reservation)
+	{
+		return reservation->abs_deadline - reservation->deadline + reservation->period;
+	}
+
+	/**
+	 * Returns the reservation class of an entity.
+	 */
+	static unsigned int class_of(const SchedulingEntity& entity)
+	{
+		unsigned int priority = (unsigned int) entity.priority();
+		return priority < EDF_NR_CLASSES ? priority : EDF_NR_CLASSES - 1;
+	}
+
+	// Runnable reserved entities, ordered on deadline, runnable reserved entities that have used
+	// their budget, ordered on when it is replenished, and runnable entities without a reservation.
+	NodeHeap deadlines;
+	NodeHeap throttled;
+	RunqueueRing background;
+	EntityTable entities;
+
+	// Class reservations held for sleeping entities, ordered on when they are released.
+	NodeHeap held;
+	EntityTable held_entities;
+
+	// The entities with a reservation of their own, whether runnable or asleep.
+	EntityTable own_reservations;
+
+	// Entities that have woken up, but have not yet been added to the runqueue.
+	WakeupQueue wakeups;
+
+	// Latency and runqueue instrumentation.
+	SchedStats stats;
+
+	// The node of the entity chosen at the last pick, if it is still runnable, and when that pick was.
+	RunqueueNode *_current;
+	uint64_t _last_pick;
+
+	// Every reservation, and those of them not in use.
+	Reservation _reservation_pool[EDF_MAX_RESERVATIONS];
+	Reservation *_free_reservations;
+
+	// The sum of the bandwidths of all admitted reservations, and how many there are.
+	uint64_t _total_bandwidth;
+	unsigned int _nr_reservations;
+
+	uint64_t _deadline_misses;
+	uint64_t _admission_failures;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(EDFScheduler);
@@ -0,0 +1,42 @@
+/*
+ * Per-Entity Scheduling Parameters Registry
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/sched.h>
+#include <infos/util/lock.h>
+
+#include "sched-entity.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+namespace sched_entity {
+	//The list of scheduling algorithms that take per-entity parameters
+	static EntityParameters *entity_parameters_head = NULL;
+
+	/**
+	 * Registers the per-entity parameters of a scheduling algorithm, so that callers can find them.
+	 */
+	void register_entity_parameters(SchedulingAlgorithm& algorithm, EntityParameters& parameters)
+	{
+		UniqueIRQLock l;
+
+		parameters._algorithm = &algorithm;
+		parameters._next = entity_parameters_head;
+		entity_parameters_head = &parameters;
+	}
+
+	EntityParameters *entity_parameters_of(const SchedulingAlgorithm& algorithm)
+	{
+		UniqueIRQLock l;
+
+		for (EntityParameters *parameters = entity_parameters_head; parameters != NULL; parameters = parameters->_next) {
+			if (parameters->_algorithm == &algorithm) return parameters;
+		}
+
+		return NULL;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+ * Per-Entity Scheduling Parameters Interface
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SCHED_ENTITY_H
+#define SCHED_ENTITY_H
+
+#include <infos/kernel/sched.h>
+
+namespace sched_entity {
+
+	/**
+	 * A scheduling algorithm that takes parameters for individual entities, on top of the
+	 * per-class defaults it reads from the kernel command line.  Whoever creates a thread
+	 * (or a system call acting for it) sets them, and the thread's teardown reports its exit:
+	 *
+	 *   EntityParameters *params = entity_parameters_of(algorithm);
+	 *   if (params && !params->set_parameters(thread, values, count)) ...rejected...
+	 *   ...
+	 *   algorithm.remove_from_runqueue(thread);
+	 *   params->entity_exited(thread);
+	 *
+	 * What the values mean depends on the algorithm, which documents them.  An algorithm
+	 * keeps the parameters of an entity while it sleeps, and only forgets them, and gives
+	 * back anything they reserved, when the entity exits.
+	 */
+	class EntityParameters {
+		friend void register_entity_parameters(infos::kernel::SchedulingAlgorithm& algorithm, EntityParameters& parameters);
+		friend EntityParameters *entity_parameters_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+
+	public:
+		EntityParameters() : _algorithm(NULL), _next(NULL) { }
+
+		/**
+		 * Sets the parameters of an entity, replacing any it had.  An entity that is runnable
+		 * is scheduled with them straight away.
+		 * @param entity The entity to set the parameters of.
+		 * @param values The parameters, whose meaning depends on the algorithm.
+		 * @param count The number of values.  Zero clears the entity's parameters, so that it
+		 * goes back to the defaults of its class.
+		 * @return Returns FALSE if the parameters are malformed, or could not be admitted, in
+		 * which case the entity keeps the parameters it had.
+		 */
+		virtual bool set_parameters(infos::kernel::SchedulingEntity& entity, const uint64_t *values, unsigned int count) = 0;
+
+		/**
+		 * Forgets everything kept for an entity.  This must be called when an entity exits,
+		 * after it has left the runqueue, and before it is destroyed.
+		 */
+		virtual void entity_exited(infos::kernel::SchedulingEntity& entity) = 0;
+
+	private:
+		const infos::kernel::SchedulingAlgorithm *_algorithm;
+		EntityParameters *_next;
+	};
+
+	void register_entity_parameters(infos::kernel::SchedulingAlgorithm& algorithm, EntityParameters& parameters);
+
+	/**
+	 * Returns the per-entity parameters of a scheduling algorithm, or NULL if it has none.
+	 */
+	EntityParameters *entity_parameters_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+}
+
+#endif /* SCHED_ENTITY_H */
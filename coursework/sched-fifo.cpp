@@ -35,37 +35,102 @@
  * In addition, the instruction lines corresponding to getch()!= '\n' which stops that test can no longer be reachable, hence why we notice this behaviour.
  * 
  */
+#include <infos/kernel/kernel.h>
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
 #include <infos/kernel/log.h>
-#include <infos/util/list.h>
 #include <infos/util/lock.h>
 
+#include "runqueue.h"
+#include "sched-sleep.h"
+#include "sched-stats.h"
+#include "sched-tick.h"
+#include "timer-wheel.h"
+
 
 
 using namespace infos::kernel;
 using namespace infos::util;
+using namespace runqueue;
+
+// The number of priority levels.  Level 0 is the highest priority.
+#define FIFO_NR_PRIORITIES 8
+// The level of a sleeper node whose wakeup expired before its entity blocked.
+#define FIFO_SLEEP_EXPIRED 1
 
 /**
- * A FIFO scheduling algorithm
+ * A FIFO scheduling algorithm, with priorities.
+ *
+ * There is one FIFO per priority level, and the entity at the head of the highest-priority
+ * non-empty level always runs, until it leaves the runqueue.  An entity that wakes up at a
+ * higher priority than the running one takes over at the next scheduling event; the entity
+ * it preempted stays at the head of its own level, and resumes once the higher levels empty.
+ * With every entity at the same priority, this is plain FIFO.
+ *
+ * Sleeping waits take the sleeping entity off the runqueue entirely, so it does not hold up
+ * lower levels, and a hierarchical timer wheel puts it back when its sleep ends (see
+ * sched-sleep.h).
  */
-class FIFOScheduler : public SchedulingAlgorithm
+class FIFOScheduler : public SchedulingAlgorithm, public sched_sleep::TimedWakeups, public sched_tick::PreemptionTicks
 {
 public:
+	FIFOScheduler() : stats("fifo"), _nonempty_levels(0)
+	{
+		sched_sleep::register_timed_wakeups(*this, *this);
+		sched_tick::register_preemption_ticks(*this, *this);
+	}
+
 	/**
 	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
 	 */
 	const char* name() const override { return "fifo"; }
 
+	/**
+	 * Arms a wakeup for an entity that is about to block.  The entity stays on the runqueue
+	 * until the kernel blocks it through remove_from_runqueue, and the timer wheel puts it
+	 * back once the given number of ticks has passed.
+	 * @param entity The entity that is going to sleep.
+	 * @param ticks How long it sleeps for, in kernel runtime ticks.
+	 */
+	void wake_after(SchedulingEntity& entity, uint64_t ticks) override
+	{
+		UniqueIRQLock l;
+
+		RunqueueNode *node = sleepers.lookup(&entity);
+		if (node == NULL) {
+			node = sleepers.insert(&entity);
+		} else if (node->level != FIFO_SLEEP_EXPIRED) {
+			timers.remove(node);
+		}
+
+		node->level = 0;
+		node->key = sys.runtime_ticks() + ticks;
+		timers.add(node);
+	}
+
+	/**
+	 * Disarms the wakeup of an entity, if it has one.
+	 */
+	void cancel_wakeup(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+		cancel_sleep(entity);
+	}
+
 	/**
 	 * Called when a scheduling entity becomes eligible for running.
 	 * @param entity
 	 */
 	void add_to_runqueue(SchedulingEntity& entity) override
-	{	//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
+	{	//Wakeups go onto a lock-free queue, so interrupts stay enabled here, and the entity joins the runqueue
+		//when the queue is next drained.  Only if that queue is full is the runqueue manipulated directly.
+		uint64_t now = sys.runtime_ticks();
+		if (wakeups.push(&entity, now)) return;
+
+		//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
 		//as the RAII wrapper helps deconstruct the l variable at the end of the lifetime of the function.
 		UniqueIRQLock l;
-		runqueue.enqueue(&entity); //Entity added to the end of the list
+		enqueue_entity(entity, now);
 	}
 
 	/**
@@ -77,8 +142,20 @@ public:
 		//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
 		//as the RAII wrapper helps deconstruct the l variable at the end of the lifetime of the function.
 		UniqueIRQLock l;
-		runqueue.remove(&entity); //Entity removed from runqueue
-		
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		//The entity always leaves the runqueue, and an armed wakeup stays on the timer wheel while it is blocked
+		dequeue_entity(entity);
+
+		//A sleep that ended before the entity got to block is over, so its wakeup goes back on the wheel,
+		//already due, and the next scheduling event puts the entity back on the runqueue
+		RunqueueNode *node = sleepers.lookup(&entity);
+		if (node && node->level == FIFO_SLEEP_EXPIRED) {
+			node->level = 0;
+			timers.add(node);
+		}
 	}
 
 	/**
@@ -88,18 +165,182 @@ public:
 	 */
 	SchedulingEntity *pick_next_entity() override
 	{
-		//Returned when there are no entities in runqueue.
-		if (runqueue.count() == 0){ 
-			return NULL; 
-		} 
-		//Return the first eligible entity from the list.
-		return runqueue.first(); 
-		
+		SchedulingEntity *next;
+
+		{
+			UniqueIRQLock l;
+			stats.pick_started();
+			stats.tick_needed(preemption_tick_needed());
+
+			drain_wakeups();
+			wake_sleepers();
+
+			//Return the first eligible entity from the highest-priority level, which keeps running until it leaves the
+			//runqueue or something of a higher priority arrives.  The lowest set bit of the bitmap is that level.
+			RunqueueNode *node = _nonempty_levels == 0 ? NULL : levels[__builtin_ctz(_nonempty_levels)].head();
+
+			stats.entity_picked(node, entities.count());
+			if (stats.dump_due()) {
+				stats.snapshot();
+				stats.snapshot_entities(levels, FIFO_NR_PRIORITIES);
+			}
+
+			//NULL is returned when there are no entities in runqueue.
+			next = node == NULL ? NULL : node->entity;
+		}
+
+		//Any statistics due are logged once the runqueue lock is released.
+		stats.flush();
+		return next;
+	}
+
+	/**
+	 * Returns TRUE if the timer needs to keep interrupting the running entity (see sched-tick.h).
+	 */
+	bool needs_preemption_tick() const override
+	{
+		UniqueIRQLock l;
+		return preemption_tick_needed();
 	}
 
 private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	/**
+	 * Returns TRUE if the timer needs to keep interrupting the running entity.  FIFO never
+	 * preempts on time: the entity that was picked is the highest-priority one, and it keeps
+	 * running until it leaves the runqueue or a higher-priority entity wakes up.  The tick is
+	 * still needed while a wakeup waits in the wakeup queue, since only the next pick moves it
+	 * onto the runqueue, and while entities are sleeping, since the tick is what wakes them.
+	 * Must be called with the runqueue lock held.
+	 */
+	bool preemption_tick_needed() const
+	{
+		return wakeups.pending() || !timers.empty();
+	}
+
+	/**
+	 * Adds an entity to the back of the runqueue.  Must be called with the runqueue lock held.
+	 * @param entity The entity to add.
+	 * @param ready_since The time at which the entity became runnable.
+	 */
+	void enqueue_entity(SchedulingEntity& entity, uint64_t ready_since)
+	{
+		//An entity is only ever queued once
+		if (entities.lookup(&entity)) return;
+
+		//A sleeping entity that is woken by something else no longer needs its timer
+		cancel_sleep(entity);
+
+		RunqueueNode *node = entities.insert(&entity);
+		node->level = priority_level(entity);
+
+		levels[node->level].enqueue(node); //Entity added to the end of its level
+		_nonempty_levels |= (1 << node->level);
+
+		stats.entity_enqueued(node, ready_since);
+	}
+
+	/**
+	 * Takes an entity off the runqueue, if it is on it.  Must be called with the runqueue lock held.
+	 */
+	void dequeue_entity(SchedulingEntity& entity)
+	{
+		RunqueueNode *node = entities.lookup(&entity);
+		if (!node) return;
+
+		dequeue(node); //Entity removed from runqueue
+		stats.entity_removed(node);
+		entities.erase(node);
+	}
+
+	void dequeue(RunqueueNode *node)
+	{
+		levels[node->level].remove(node);
+
+		if (levels[node->level].empty()) {
+			_nonempty_levels &= ~(1 << node->level);
+		}
+	}
+
+	/**
+	 * Disarms the wakeup of an entity, if it has one.  Must be called with the runqueue lock held.
+	 */
+	void cancel_sleep(SchedulingEntity& entity)
+	{
+		RunqueueNode *node = sleepers.lookup(&entity);
+		if (!node) return;
+
+		if (node->level != FIFO_SLEEP_EXPIRED) timers.remove(node);
+		sleepers.erase(node);
+	}
+
+	/**
+	 * Returns the priority level of an entity.  Lower entity priority values are more important,
+	 * and any beyond the last level share it.
+	 */
+	static unsigned int priority_level(const SchedulingEntity& entity)
+	{
+		unsigned int priority = (unsigned int) entity.priority();
+		return priority < FIFO_NR_PRIORITIES ? priority : FIFO_NR_PRIORITIES - 1;
+	}
+
+	/**
+	 * Moves every entity waiting in the wakeup queue onto the runqueue, in the order they woke up.
+	 * Must be called with the runqueue lock held.
+	 */
+	void drain_wakeups()
+	{
+		SchedulingEntity *entity;
+		uint64_t ready_since;
+
+		while (wakeups.pop(entity, ready_since)) {
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	/**
+	 * Advances the timer wheel to the current time, and moves every entity whose sleep has ended
+	 * back onto the runqueue, in the order their sleeps ended.  Must be called with the runqueue
+	 * lock held.
+	 */
+	void wake_sleepers()
+	{
+		RunqueueNode *node;
+
+		timers.advance(sys.runtime_ticks());
+
+		while (timers.pop_expired(node)) {
+			SchedulingEntity *entity = node->entity;
+			uint64_t ready_since = node->key;
+
+			//An entity whose sleep ends before it has blocked is woken as soon as it blocks, so its
+			//node is kept, marked, for remove_from_runqueue to put back on the wheel
+			if (entities.lookup(entity)) {
+				node->level = FIFO_SLEEP_EXPIRED;
+				continue;
+			}
+
+			sleepers.erase(node);
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	// One FIFO per priority level, and the table that finds an entity's node.
+	RunqueueRing levels[FIFO_NR_PRIORITIES];
+	EntityTable entities;
+
+	// Entities that have woken up, but have not yet been added to the runqueue.
+	WakeupQueue wakeups;
+
+	// Entities with an armed wakeup, and the wheel of timers that wakes them.  A node's level is
+	// FIFO_SLEEP_EXPIRED once it is off the wheel because the wakeup expired before the entity blocked.
+	EntityTable sleepers;
+	TimerWheel timers;
+
+	// Latency and runqueue instrumentation.
+	SchedStats stats;
+
+	// Bit n is set when priority level n has something to run.
+	uint32_t _nonempty_levels;
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
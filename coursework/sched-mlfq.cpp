@@ -0,0 +1,230 @@
+/*
+ * Multi-level Feedback Queue Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "runqueue.h"
+#include "sched-stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace runqueue;
+
+// The number of priority levels.  Level 0 is the highest priority.
+#define MLFQ_NR_LEVELS 4
+// The number of scheduling events between priority boosts.
+#define MLFQ_BOOST_INTERVAL 100
+
+/**
+ * A multi-level feedback queue scheduling algorithm.
+ *
+ * Each level is a round-robin ring, and the highest non-empty level always runs.  An entity
+ * that uses up the quantum of its level is demoted to the level below, so CPU-bound entities
+ * sink while entities that block frequently stay near the top.  Entities that wake up start
+ * again at the top level, and every entity is periodically boosted back to the top so that
+ * nothing starves.
+ */
+class MLFQScheduler : public SchedulingAlgorithm
+{
+public:
+	MLFQScheduler() : stats("mlfq"), _current(NULL), _nonempty_levels(0), _ticks_until_boost(MLFQ_BOOST_INTERVAL) { }
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "mlfq"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		//Wakeups go onto a lock-free queue, and join a level when the queue is next drained
+		uint64_t now = sys.runtime_ticks();
+		if (wakeups.push(&entity, now)) return;
+
+		UniqueIRQLock l;
+		enqueue_entity(entity, now);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *node = entities.lookup(&entity);
+		if (!node) return;
+
+		dequeue(node);
+		if (_current == node) _current = NULL;
+
+		stats.entity_removed(node);
+		entities.erase(node);
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The next eligible entity might actually be the same entity, if
+	 * e.g. its quantum has not expired and nothing of a higher priority is runnable.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		SchedulingEntity *next;
+
+		{
+			UniqueIRQLock l;
+			stats.pick_started();
+
+			drain_wakeups();
+
+			if (--_ticks_until_boost == 0) {
+				boost();
+				_ticks_until_boost = MLFQ_BOOST_INTERVAL;
+			}
+
+			//Charge the entity that was running for this tick, and demote it once it has used its whole quantum.
+			//Demotion moves it to the back of the level below (or the back of the lowest level).
+			if (_current != NULL) {
+				_current->ticks++;
+
+				if (_current->ticks >= quantum(_current->level)) {
+					unsigned int level = _current->level + 1 < MLFQ_NR_LEVELS ? _current->level + 1 : _current->level;
+
+					dequeue(_current);
+					enqueue(_current, level);
+				}
+			}
+
+			//The lowest set bit is the highest-priority level that has something to run.  An entity that
+			//was preempted by a higher level stays at the head of its own level, with the ticks it has used.
+			_current = _nonempty_levels == 0 ? NULL : levels[__builtin_ctz(_nonempty_levels)].head();
+
+			stats.entity_picked(_current, entities.count());
+			if (stats.dump_due()) {
+				stats.snapshot();
+				stats.snapshot_entities(levels, MLFQ_NR_LEVELS);
+			}
+
+			next = _current == NULL ? NULL : _current->entity;
+		}
+
+		//Any statistics due are logged once the runqueue lock is released.
+		stats.flush();
+		return next;
+	}
+
+private:
+	/**
+	 * Returns the quantum, in scheduling events, of the given level.  Lower levels get
+	 * longer quanta, since the entities there are the ones that are happy to run for longer.
+	 */
+	static unsigned int quantum(unsigned int level)
+	{
+		return 1 << level;
+	}
+
+	/**
+	 * Adds a newly runnable entity.  Entities that have just become runnable (including ones
+	 * that have just woken up) start at the top level.  Must be called with the runqueue lock held.
+	 */
+	void enqueue_entity(SchedulingEntity& entity, uint64_t ready_since)
+	{
+		//An entity is only ever queued once
+		if (entities.lookup(&entity)) return;
+
+		RunqueueNode *node = entities.insert(&entity);
+		enqueue(node, 0);
+		stats.entity_enqueued(node, ready_since);
+	}
+
+	/**
+	 * Moves every entity waiting in the wakeup queue onto the top level, in the order they woke up.
+	 * Must be called with the runqueue lock held.
+	 */
+	void drain_wakeups()
+	{
+		SchedulingEntity *entity;
+		uint64_t ready_since;
+
+		while (wakeups.pop(entity, ready_since)) {
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	void enqueue(RunqueueNode *node, unsigned int level)
+	{
+		node->level = level;
+		node->ticks = 0;
+
+		levels[level].enqueue(node);
+		_nonempty_levels |= (1 << level);
+	}
+
+	void dequeue(RunqueueNode *node)
+	{
+		levels[node->level].remove(node);
+
+		if (levels[node->level].empty()) {
+			_nonempty_levels &= ~(1 << node->level);
+		}
+	}
+
+	/**
+	 * Moves every entity back to the top level.
+	 */
+	void boost()
+	{
+		for (unsigned int level = 1; level < MLFQ_NR_LEVELS; level++) {
+			while (!levels[level].empty()) {
+				RunqueueNode *node = levels[level].head();
+
+				dequeue(node);
+				enqueue(node, 0);
+			}
+		}
+
+		// Entities already at the top get a fresh quantum too.
+		if (!levels[0].empty()) {
+			RunqueueNode *node = levels[0].head();
+			do {
+				node->ticks = 0;
+				node = node->next;
+			} while (node != levels[0].head());
+		}
+	}
+
+	// One round-robin ring per level, and the table that finds an entity's node.
+	RunqueueRing levels[MLFQ_NR_LEVELS];
+	EntityTable entities;
+
+	// Entities that have woken up, but have not yet been added to a level.
+	WakeupQueue wakeups;
+
+	// Latency and runqueue instrumentation.
+	SchedStats stats;
+
+	// The node of the entity chosen at the last scheduling event, if it is still runnable.
+	RunqueueNode *_current;
+	// Bit n is set when level n has something to run.
+	uint32_t _nonempty_levels;
+	unsigned int _ticks_until_boost;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(MLFQScheduler);
@@ -0,0 +1,62 @@
+/*
+ * Scheduler Parameters
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SCHED_PARAMS_H
+#define SCHED_PARAMS_H
+
+#include <infos/define.h>
+
+namespace sched_params {
+
+	/**
+	 * Reads an unsigned decimal number, and moves past it.
+	 * @return Returns FALSE if there is no number there, or it does not fit in 64 bits.
+	 */
+	static inline bool read_number(const char *& p, uint64_t& value)
+	{
+		if (*p < '0' || *p > '9') return false;
+
+		value = 0;
+		while (*p >= '0' && *p <= '9') {
+			uint64_t digit = *p++ - '0';
+			if (value > (~0ULL - digit) / 10) return false;
+
+			value = (value * 10) + digit;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Reads the next entry of a kernel command-line value made of comma-separated entries of
+	 * colon-separated numbers, such as "0:2,3:8", and moves past it and its comma.
+	 * @param values Receives the numbers of the entry.
+	 * @param max_values The most numbers an entry may have.
+	 * @return Returns the number of numbers in the entry, zero at the end of the value, or
+	 * -1 if the entry is malformed (after which nothing more should be read).
+	 */
+	static inline int read_entry(const char *& p, uint64_t *values, unsigned int max_values)
+	{
+		if (*p == 0) return 0;
+
+		unsigned int nr_values = 0;
+		for (;;) {
+			if (nr_values == max_values || !read_number(p, values[nr_values])) return -1;
+			nr_values++;
+
+			if (*p != ':') break;
+			p++;
+		}
+
+		if (*p == ',') p++;
+		else if (*p != 0) return -1;
+
+		return nr_values;
+	}
+}
+
+#endif
@@ -6,22 +6,112 @@
 /*
  * STUDENT NUMBER: s1870697
  */
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/cmdline.h>
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
 #include <infos/kernel/log.h>
 #include <infos/util/list.h>
 #include <infos/util/lock.h>
 
+#include "runqueue.h"
+#include "sched-entity.h"
+#include "sched-params.h"
+#include "sched-stats.h"
+#include "sched-tick.h"
+
 
 using namespace infos::kernel;
 using namespace infos::util;
+using namespace runqueue;
+
+// The number of scheduling classes.  An entity's class is its priority, and any beyond the last class share it.
+#define RR_NR_CLASSES 8
+// The quantum, in scheduling events, of a class that has not been given some other quantum.
+#define RR_DEFAULT_QUANTUM 1
+// The longest quantum that may be configured.
+#define RR_MAX_QUANTUM 64
+// In adaptive mode, the most times an entity's quantum may be doubled.
+#define RR_MAX_QUANTUM_SHIFT 3
+// In adaptive mode, the number of runnable interactive entities at which extended quanta are withdrawn.
+#define RR_CROWDED_INTERACTIVE 4
+// How long, in ticks, an entity's cache is taken to stay warm after it stops running.
+#define RR_AFFINITY_WINDOW 2
+// The most picks in a row that may jump the ring for cache affinity.
+#define RR_AFFINITY_MAX_DEBT 2
+
+// The quantum of each class, or zero for RR_DEFAULT_QUANTUM, and whether quanta adapt.  Both
+// are set from the kernel command line, before any entity is runnable.
+static unsigned int rr_class_quanta[RR_NR_CLASSES];
+static bool rr_adaptive;
+
+/**
+ * sched.rr.quantum=<quantum> sets the quantum of every class, and sched.rr.quantum=<class>:<quantum>,...
+ * sets the quanta of particular classes.  Entries apply in order, so "2,0:1" gives class 0 a quantum
+ * of one and every other class a quantum of two.  Quanta are between 1 and RR_MAX_QUANTUM.
+ */
+RegisterCmdLineArgument(RRQuantum, "sched.rr.quantum")
+{
+	const char *p = value;
+	uint64_t values[2];
+	int nr_values;
+
+	while ((nr_values = sched_params::read_entry(p, values, 2)) > 0) {
+		uint64_t quantum = values[nr_values - 1];
+		if (quantum == 0 || quantum > RR_MAX_QUANTUM || (nr_values == 2 && values[0] >= RR_NR_CLASSES)) {
+			nr_values = -1;
+			break;
+		}
+
+		for (unsigned int i = 0; i < RR_NR_CLASSES; i++) {
+			if (nr_values == 1 || values[0] == i) rr_class_quanta[i] = quantum;
+		}
+	}
+
+	if (nr_values < 0) {
+		syslog.messagef(LogLevel::WARNING, "rr: sched.rr.quantum=%s is malformed, and was only applied up to '%s'", value, p);
+	}
+}
+
+/**
+ * sched.rr.adaptive=1 turns adaptive quanta on.
+ */
+RegisterCmdLineArgument(RRAdaptive, "sched.rr.adaptive")
+{
+	rr_adaptive = value[0] == '1';
+}
 
 /**
  * A round-robin scheduling algorithm
+ *
+ * The entity at the head of the ring runs until it has used its quantum, and then moves to the
+ * back.  An entity's quantum is its own if it has been given one with set_parameters() (see
+ * sched-entity.h), with the values { quantum }, and otherwise the quantum of its class, which is
+ * its priority.  In adaptive mode, an entity that
+ * uses its whole quantum has it doubled (up to RR_MAX_QUANTUM_SHIFT times), so CPU-bound
+ * entities switch less often.  Entities that have not yet used a whole quantum since becoming
+ * runnable count as interactive, and while RR_CROWDED_INTERACTIVE or more of them are runnable,
+ * everything falls back to its base quantum so that they get to respond sooner.  Class quanta
+ * and adaptive mode are set on the kernel command line.
+ *
+ * When the running entity leaves the runqueue before its quantum is up, and is runnable again
+ * within RR_AFFINITY_WINDOW ticks, it rejoins the ring as the next entity to run rather than
+ * waiting behind everything else, since its working set is probably still in the cache.  If
+ * another entity has started a quantum in the meantime, it is not preempted: the returning
+ * entity goes directly behind it.  Each jump puts the others further behind, so at most
+ * RR_AFFINITY_MAX_DEBT jumps are allowed before some other entity takes its turn in ring order.
  */
-class RoundRobinScheduler : public SchedulingAlgorithm
+class RoundRobinScheduler : public SchedulingAlgorithm, public sched_entity::EntityParameters,
+	public sched_tick::PreemptionTicks
 {
 public:
+	RoundRobinScheduler() : stats("rr"), _current(NULL), _last_run(NULL), _last_run_end(0), _jumped(NULL),
+		_affinity_debt(0), _nr_interactive(0)
+	{
+		sched_entity::register_entity_parameters(*this, *this);
+		sched_tick::register_preemption_ticks(*this, *this);
+	}
+
 	/**
 	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
 	 */
@@ -33,10 +123,15 @@ public:
 	 */
 	void add_to_runqueue(SchedulingEntity& entity) override
 	{
+		//Wakeups go onto a lock-free queue, so interrupts stay enabled here, and the entity joins the ring
+		//when the queue is next drained.  Only if that queue is full is the ring manipulated directly.
+		uint64_t now = sys.runtime_ticks();
+		if (wakeups.push(&entity, now)) return;
+
 		//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
 		//as the RAII wrapper helps deconstruct the l variable at the end of the lifetime of the function.
 		UniqueIRQLock l;
-		runqueue.enqueue(&entity); //appends entity to end of list
+		enqueue_entity(entity, now);
 	}
 
 	/**
@@ -48,7 +143,84 @@ public:
 		//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
 		//as the RAII wrapper helps deconstruct the l variable at the end of the lifetime of the function.
 		UniqueIRQLock l;
-		runqueue.remove(&entity); //removes entitiy
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		//The table finds the entity's node directly, so there is no search through the runqueue
+		RunqueueNode *node = entities.lookup(&entity);
+		if (!node) return;
+
+		//An entity that leaves while running gives up the rest of its quantum
+		if (_current == node) {
+			_last_run = &entity;
+			_last_run_end = sys.runtime_ticks();
+		}
+
+		dequeue(node);
+	}
+
+	/**
+	 * Sets the parameters of an entity: { quantum }.
+	 */
+	bool set_parameters(SchedulingEntity& entity, const uint64_t *values, unsigned int count) override
+	{
+		if (count > 1) return false;
+
+		return set_quantum(entity, count == 0 ? 0 : values[0]);
+	}
+
+	/**
+	 * Gives an entity its own quantum, between 1 and RR_MAX_QUANTUM, or with zero, goes back to
+	 * the quantum of its class.  A runnable entity starts over at its new quantum straight away,
+	 * and counts as interactive again until it uses it up.
+	 * @return Returns FALSE if the quantum is out of range.
+	 */
+	bool set_quantum(SchedulingEntity& entity, uint64_t quantum)
+	{
+		if (quantum > RR_MAX_QUANTUM) return false;
+
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *record = records.lookup(&entity);
+		if (quantum == 0) {
+			if (record) records.erase(record);
+		} else {
+			if (!record) record = records.insert(&entity);
+			record->weight = quantum;
+		}
+
+		RunqueueNode *node = entities.lookup(&entity);
+		if (node) {
+			if (node->level != 0) _nr_interactive++;
+
+			node->weight = base_quantum(entity);
+			node->level = 0;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Forgets the quantum of an entity, and that it ran last.
+	 */
+	void entity_exited(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		drain_wakeups();
+
+		//The entity should have left the runqueue already, but make sure nothing refers to it
+		RunqueueNode *node = entities.lookup(&entity);
+		if (node) dequeue(node);
+
+		RunqueueNode *record = records.lookup(&entity);
+		if (record) records.erase(record);
+
+		if (_last_run == &entity) _last_run = NULL;
 	}
 
 	/**
@@ -58,29 +230,226 @@ public:
 	 */
 	SchedulingEntity *pick_next_entity() override
 	{
-		
-		if (runqueue.count() == 0) return NULL; //Returned when there are no entities in runqueue.
+		SchedulingEntity *next;
 
-		if (runqueue.count() == 1) return runqueue.first(); //Return the only entity in runqueue.
-		
-        //Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
-		//as the RAII wrapper helps deconstruct the l variable at the end of the lifetime of the function.
-		UniqueIRQLock l;
-		
-		//When a new task is to be picked for execution, it is removed from the front of the list, and placed at the back.  
-		// Then, this task is allowed to run for its timeslice.
-		auto entity = runqueue.first(); 
-		runqueue.remove(entity); 
-		runqueue.append(entity);
-		return entity;
-	
+		{
+			//Interrupts should be disabled when manipulating the runqueue. There will be no need to handle any errors of resource leaks
+			//as the RAII wrapper helps deconstruct the l variable at the end of the block.
+			UniqueIRQLock l;
+			stats.pick_started();
+			stats.tick_needed(preemption_tick_needed());
+
+			drain_wakeups();
+
+			//Charge the entity that was running for this tick.  Once it has used its quantum, the head of the ring is advanced
+			//past it, which places it at the back.  With a single entity this leaves the head where it was.
+			if (_current != NULL) {
+				_current->ticks++;
 
+				if (_current->ticks >= quantum(_current)) {
+					stats.quantum_ended(_current->ticks, true);
+					if (rr_adaptive) extend_quantum(_current);
 
+					_current->ticks = 0;
+					runqueue.rotate();
+				}
+			}
+
+			//The head of the ring is the entity that is allowed to run for the rest of its timeslice.  A turn
+			//that starts in ring order, rather than by jumping the ring, pays off the affinity debt.
+			RunqueueNode *node = runqueue.head();
+			if (node != NULL && node != _current && node != _jumped) _affinity_debt = 0;
+
+			_current = node;
+
+			stats.entity_picked(node, runqueue.count());
+			if (stats.dump_due()) {
+				stats.snapshot();
+				stats.snapshot_entities(&runqueue, 1);
+			}
+
+			next = node == NULL ? NULL : node->entity; //NULL is returned when there are no entities in runqueue.
+		}
+
+		//Any statistics due are logged once the runqueue lock is released.
+		stats.flush();
+		return next;
+	}
+
+	/**
+	 * Returns TRUE if the timer needs to keep interrupting the running entity (see sched-tick.h).
+	 */
+	bool needs_preemption_tick() const override
+	{
+		UniqueIRQLock l;
+		return preemption_tick_needed();
 	}
 
 private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	/**
+	 * Returns TRUE if the timer needs to keep interrupting the running entity.  Round-robin only
+	 * preempts to share the CPU, so when the CPU is idle or a single entity is runnable, there is
+	 * nothing for a tick to do until the next wakeup.  A wakeup waits in the wakeup queue until
+	 * the next pick moves it onto the runqueue, so the tick is needed while one is pending.
+	 * Must be called with the runqueue lock held.
+	 */
+	bool preemption_tick_needed() const
+	{
+		return wakeups.pending() || runqueue.count() > 1;
+	}
+
+	/**
+	 * Adds an entity to the back of the ring.  Must be called with the runqueue lock held.
+	 * @param entity The entity to add.
+	 * @param ready_since The time at which the entity became runnable.
+	 */
+	void enqueue_entity(SchedulingEntity& entity, uint64_t ready_since)
+	{
+		//An entity is only ever queued once
+		if (entities.lookup(&entity)) return;
+
+		//Every entity starts at its base quantum, and counts as interactive until it uses it up
+		RunqueueNode *node = entities.insert(&entity);
+		node->weight = base_quantum(entity);
+		_nr_interactive++;
+
+		if (!prefer_last_run(node, ready_since)) {
+			runqueue.enqueue(node); //appends entity to end of ring
+		}
+
+		stats.entity_enqueued(node, ready_since);
+	}
+
+	/**
+	 * Takes a node off the ring, and forgets it.  A node that was running gives up the rest of its
+	 * quantum.  Must be called with the runqueue lock held.
+	 */
+	void dequeue(RunqueueNode *node)
+	{
+		if (_current == node) {
+			stats.quantum_ended(node->ticks, false);
+			_current = NULL;
+		}
+		if (node->level == 0) _nr_interactive--;
+		if (_jumped == node) _jumped = NULL;
+
+		runqueue.remove(node); //unlinks entity
+		stats.entity_removed(node);
+		entities.erase(node);
+	}
+
+	/**
+	 * Places a newly runnable node next in line, if it is the entity that ran last, it has come
+	 * back while its cache is likely to be warm, and the fairness debt allows another jump.  Must
+	 * be called with the runqueue lock held.
+	 * @param node The node of the entity, which is not yet on the ring.
+	 * @param ready_since The time at which the entity became runnable.
+	 * @return Returns TRUE if the node was placed on the ring.
+	 */
+	bool prefer_last_run(RunqueueNode *node, uint64_t ready_since)
+	{
+		if (node->entity != _last_run) return false;
+
+		//The entity is back, so whether or not it jumps, its absence is over
+		_last_run = NULL;
+
+		if (ready_since - _last_run_end > RR_AFFINITY_WINDOW || _affinity_debt >= RR_AFFINITY_MAX_DEBT) return false;
+
+		//An entity that has started its quantum keeps it, and the returning entity runs after it
+		if (_current != NULL) {
+			runqueue.insert_after(_current, node);
+		} else {
+			runqueue.push_front(node);
+		}
+
+		_jumped = node;
+		_affinity_debt++;
+		stats.affinity_pick();
+
+		return true;
+	}
+
+	/**
+	 * Returns the quantum an entity starts with, which is its own, or the quantum of its class.
+	 */
+	unsigned int base_quantum(SchedulingEntity& entity) const
+	{
+		const RunqueueNode *record = records.lookup(&entity);
+		if (record) return record->weight;
+
+		unsigned int priority = (unsigned int) entity.priority();
+		unsigned int quantum = rr_class_quanta[priority < RR_NR_CLASSES ? priority : RR_NR_CLASSES - 1];
+
+		return quantum == 0 ? RR_DEFAULT_QUANTUM : quantum;
+	}
+
+	/**
+	 * Returns the quantum of a runnable entity, in scheduling events.  The level of a node is the
+	 * number of times its base quantum has been doubled.
+	 */
+	unsigned int quantum(const RunqueueNode *node) const
+	{
+		if (_nr_interactive >= RR_CROWDED_INTERACTIVE) return node->weight;
+		return node->weight << node->level;
+	}
+
+	/**
+	 * Doubles the quantum of an entity that has used its whole quantum, unless interactive entities
+	 * are crowding the runqueue.  An entity's first extension means it no longer counts as interactive.
+	 */
+	void extend_quantum(RunqueueNode *node)
+	{
+		if (node->level != 0 && _nr_interactive >= RR_CROWDED_INTERACTIVE) return;
+
+		if (node->level < RR_MAX_QUANTUM_SHIFT && (node->weight << (node->level + 1)) <= RR_MAX_QUANTUM) {
+			if (node->level == 0) _nr_interactive--;
+			node->level++;
+		}
+	}
+
+	/**
+	 * Moves every entity waiting in the wakeup queue onto the ring, in the order they woke up.
+	 * Must be called with the runqueue lock held.
+	 */
+	void drain_wakeups()
+	{
+		SchedulingEntity *entity;
+		uint64_t ready_since;
+
+		while (wakeups.pop(entity, ready_since)) {
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	// The runqueue, as a ring of nodes, and the table that finds an entity's node.
+	RunqueueRing runqueue;
+	EntityTable entities;
+
+	// The entities that have been given their own quantum, which is kept in the weight until
+	// they exit, whether they are runnable or not.
+	EntityTable records;
+
+	// Entities that have woken up, but have not yet been added to the ring.
+	WakeupQueue wakeups;
+
+	// Latency and runqueue instrumentation.
+	SchedStats stats;
+
+	// The node of the entity chosen at the last scheduling event, if it is still runnable.
+	RunqueueNode *_current;
+
+	// The entity that last left the CPU before its quantum was up and has not come back, and
+	// when it left.
+	SchedulingEntity *_last_run;
+	uint64_t _last_run_end;
+
+	// The node that last jumped the ring, if it is still runnable, and the number of jumps
+	// since a turn last started in ring order.
+	RunqueueNode *_jumped;
+	unsigned int _affinity_debt;
+
+	// The number of runnable entities that have not used up a quantum.
+	unsigned int _nr_interactive;
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
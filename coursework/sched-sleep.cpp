@@ -0,0 +1,42 @@
+/*
+ * Timed Sleep Wakeup Registry
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/sched.h>
+#include <infos/util/lock.h>
+
+#include "sched-sleep.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+namespace sched_sleep {
+	//The list of scheduling algorithms that have timed wakeups
+	static TimedWakeups *timed_wakeups_head = NULL;
+
+	/**
+	 * Registers the timed wakeups of a scheduling algorithm, so that sleeping waits can find them.
+	 */
+	void register_timed_wakeups(SchedulingAlgorithm& algorithm, TimedWakeups& wakeups)
+	{
+		UniqueIRQLock l;
+
+		wakeups._algorithm = &algorithm;
+		wakeups._next = timed_wakeups_head;
+		timed_wakeups_head = &wakeups;
+	}
+
+	TimedWakeups *timed_wakeups_of(const SchedulingAlgorithm& algorithm)
+	{
+		UniqueIRQLock l;
+
+		for (TimedWakeups *wakeups = timed_wakeups_head; wakeups != NULL; wakeups = wakeups->_next) {
+			if (wakeups->_algorithm == &algorithm) return wakeups;
+		}
+
+		return NULL;
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * Timed Sleep Interface
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SCHED_SLEEP_H
+#define SCHED_SLEEP_H
+
+#include <infos/kernel/sched.h>
+
+namespace sched_sleep {
+
+	/**
+	 * A scheduling algorithm that can end sleeps on a timer.  A sleeping wait (such as
+	 * usleep) arms a wakeup for the thread, and then blocks it the usual way:
+	 *
+	 *   TimedWakeups *timed = timed_wakeups_of(algorithm);
+	 *   timed->wake_after(thread, ticks);
+	 *   thread.sleep();     // leaves the runqueue through remove_from_runqueue()
+	 *   thread.wake_up();   // once running again, restores the thread's own state
+	 *
+	 * While the thread sleeps it is off the runqueue, so it costs no CPU time.  When the
+	 * wakeup expires, the algorithm puts the entity back on its runqueue itself.  The
+	 * wake_up() afterwards only brings the kernel's view of the thread up to date: the entity
+	 * is already queued, so it adds nothing.  A thread that is woken some other way before
+	 * its wakeup expires has the wakeup disarmed.
+	 */
+	class TimedWakeups {
+		friend void register_timed_wakeups(infos::kernel::SchedulingAlgorithm& algorithm, TimedWakeups& wakeups);
+		friend TimedWakeups *timed_wakeups_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+
+	public:
+		TimedWakeups() : _algorithm(NULL), _next(NULL) { }
+
+		/**
+		 * Arms a wakeup for an entity, which must be about to block.  Arming it again
+		 * replaces the earlier wakeup.
+		 * @param entity The entity that is going to sleep.
+		 * @param ticks How long it sleeps for, in kernel runtime ticks.
+		 */
+		virtual void wake_after(infos::kernel::SchedulingEntity& entity, uint64_t ticks) = 0;
+
+		/**
+		 * Disarms the wakeup of an entity, if it has one.  This must be called before a
+		 * sleeping entity is destroyed.
+		 */
+		virtual void cancel_wakeup(infos::kernel::SchedulingEntity& entity) = 0;
+
+	private:
+		const infos::kernel::SchedulingAlgorithm *_algorithm;
+		TimedWakeups *_next;
+	};
+
+	void register_timed_wakeups(infos::kernel::SchedulingAlgorithm& algorithm, TimedWakeups& wakeups);
+
+	/**
+	 * Returns the timed wakeups of a scheduling algorithm, or NULL if it has none, in which
+	 * case sleeping waits have to poll.
+	 */
+	TimedWakeups *timed_wakeups_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+}
+
+#endif /* SCHED_SLEEP_H */
@@ -0,0 +1,379 @@
+/*
+ * Scheduler Statistics
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SCHED_STATS_H
+#define SCHED_STATS_H
+
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+#include <infos/util/printf.h>
+
+#include <stdarg.h>
+
+#include "runqueue.h"
+
+// The number of power-of-two buckets in a histogram.
+#define SCHED_STATS_NR_BUCKETS 16
+// The number of scheduling events between statistics dumps.
+#define SCHED_STATS_DUMP_INTERVAL 10000
+// The most runnable entities listed in one dump.
+#define SCHED_STATS_MAX_ENTITIES 32
+
+namespace runqueue {
+
+	/**
+	 * A histogram with power-of-two buckets: bucket 0 counts zeroes, and bucket n counts
+	 * values in [2^(n-1), 2^n).  The last bucket also counts everything larger.
+	 */
+	struct Histogram {
+		uint64_t buckets[SCHED_STATS_NR_BUCKETS];
+
+		void record(uint64_t value) {
+			unsigned int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+			if (bucket >= SCHED_STATS_NR_BUCKETS) bucket = SCHED_STATS_NR_BUCKETS - 1;
+
+			buckets[bucket]++;
+		}
+
+		/**
+		 * Writes the buckets as a comma-separated list.  If the buffer is too small, the list is cut short.
+		 */
+		void format(char *buffer, size_t size) const {
+			size_t used = 0;
+
+			buffer[0] = 0;
+			for (unsigned int i = 0; i < SCHED_STATS_NR_BUCKETS; i++) {
+				int n = infos::util::snprintf(buffer + used, size - used, i == 0 ? "%lu" : ",%lu", buckets[i]);
+				if (n < 0 || (size_t) n >= size - used) break;
+
+				used += n;
+			}
+		}
+	};
+
+	/**
+	 * Scheduler instrumentation, recorded at the add/pick/remove boundary.  Each hook costs
+	 * a clock read and a few counter updates, so it is left on.  Every scheduler emits the
+	 * same lines, so runs of different policies under the same workload can be compared
+	 * directly from their logs.  Every SCHED_STATS_DUMP_INTERVAL picks the statistics are
+	 * written to the debug log as key=value lines: one global line, one line of policy
+	 * state, and one line per entity the policy lists, which are the runnable ones and any
+	 * it keeps state for while they sleep (up to SCHED_STATS_MAX_ENTITIES).  Times are in
+	 * kernel runtime ticks.
+	 *
+	 * Like the runqueue itself, the statistics are only updated with the runqueue lock held.
+	 * Formatting and logging a dump is slow, so it is taken in two steps: the pick takes a
+	 * snapshot with the lock held, and flushes it to the log once the lock has been released.
+	 * In the kernel the pick runs from the timer interrupt, so the flush still runs with
+	 * interrupts disabled; that cost is only paid once every SCHED_STATS_DUMP_INTERVAL picks.
+	 */
+	class SchedStats {
+	public:
+		SchedStats(const char *scheduler_name) : _scheduler_name(scheduler_name), _last(NULL),
+			_nr_enqueues(0), _nr_picks(0), _nr_switches(0), _suppressible_ticks(0),
+			_nr_quanta_expired(0), _nr_quanta_yielded(0), _nr_affinity_picks(0), _interval_switches(0), _interval_start(0),
+			_until_dump(SCHED_STATS_DUMP_INTERVAL), _pick_start(0), _pending(false) {
+			for (unsigned int i = 0; i < SCHED_STATS_NR_BUCKETS; i++) {
+				_wait_latency.buckets[i] = 0;
+				_slice_length.buckets[i] = 0;
+				_runqueue_length.buckets[i] = 0;
+				_pick_cycles.buckets[i] = 0;
+				_quantum_use.buckets[i] = 0;
+			}
+		}
+
+		/**
+		 * Records that an entity has become ready to run.
+		 * @param node The node of the entity.
+		 * @param ready_since The time at which the entity became runnable, which may be
+		 * earlier than the time it was added to the runqueue.
+		 */
+		void entity_enqueued(RunqueueNode *node, uint64_t ready_since) {
+			node->ready_since = ready_since;
+			_nr_enqueues++;
+		}
+
+		/**
+		 * Records that an entity is no longer runnable.  If it was running, this ends its slice.
+		 */
+		void entity_removed(RunqueueNode *node) {
+			if (node == _last) {
+				_slice_length.record(infos::kernel::sys.runtime_ticks() - node->run_start);
+				_last = NULL;
+			}
+		}
+
+		/**
+		 * Records the start of a pick, so that its cost can be measured.  Cost is measured in
+		 * CPU cycles rather than runtime ticks, which are far too coarse for a single pick.
+		 */
+		void pick_started() {
+			_pick_start = __builtin_ia32_rdtsc();
+		}
+
+		/**
+		 * Records the result of a pick.  When the pick switches to a different entity, this ends
+		 * the slice of the entity that was running (which goes back to waiting), and records how
+		 * long the new entity waited to run.
+		 * @param next The node that was picked, or NULL if nothing was runnable.
+		 * @param nr_runnable The number of runnable entities at the time of the pick.
+		 */
+		void entity_picked(RunqueueNode *next, unsigned int nr_runnable) {
+			uint64_t now = infos::kernel::sys.runtime_ticks();
+
+			_nr_picks++;
+			_runqueue_length.record(nr_runnable);
+			_pick_cycles.record(__builtin_ia32_rdtsc() - _pick_start);
+
+			if (next != _last) {
+				if (_last != NULL) {
+					_slice_length.record(now - _last->run_start);
+					_last->ready_since = now;
+				}
+
+				if (next != NULL) {
+					uint64_t waited = now - next->ready_since;
+
+					_wait_latency.record(waited);
+					next->wait_total += waited;
+					next->nr_runs++;
+					next->run_start = now;
+
+					_nr_switches++;
+					_interval_switches++;
+				}
+
+				_last = next;
+			}
+		}
+
+		/**
+		 * Records whether the policy needed the periodic tick that led to this pick.  A tick
+		 * that arrives when the policy does not need one would have been suppressed on a
+		 * tickless timer, so this counts the interrupts that adaptive ticks would save.  It
+		 * must be called before the pick drains its wakeups, so that an entity that woke up
+		 * since the last pick counts as needing the tick.
+		 * @param needed TRUE if the policy needs a preemption tick.
+		 */
+		void tick_needed(bool needed) {
+			if (!needed) _suppressible_ticks++;
+		}
+
+		/**
+		 * Records that an entity was placed out of the policy's order, to run while its cache
+		 * is likely to still be warm.
+		 */
+		void affinity_pick() {
+			_nr_affinity_picks++;
+		}
+
+		/**
+		 * Records the end of a quantum.
+		 * @param ticks The number of scheduling events of the quantum that were used.
+		 * @param expired TRUE if the whole quantum was used, or FALSE if the entity left the
+		 * runqueue before it was.
+		 */
+		void quantum_ended(unsigned int ticks, bool expired) {
+			if (expired) _nr_quanta_expired++;
+			else _nr_quanta_yielded++;
+
+			_quantum_use.record(ticks);
+		}
+
+		/**
+		 * Counts down to the next periodic dump.
+		 * @return Returns TRUE when the statistics should be dumped.
+		 */
+		bool dump_due() {
+			if (--_until_dump > 0) return false;
+
+			_until_dump = SCHED_STATS_DUMP_INTERVAL;
+			return true;
+		}
+
+		/**
+		 * Takes a snapshot of the statistics, to be logged by flush(), and starts a new interval.
+		 * Must be called with the runqueue lock held.  The snapshot has no runnable entities
+		 * and no policy state until they are added.
+		 */
+		void snapshot() {
+			uint64_t now = infos::kernel::sys.runtime_ticks();
+
+			_snapshot.nr_enqueues = _nr_enqueues;
+			_snapshot.nr_picks = _nr_picks;
+			_snapshot.nr_switches = _nr_switches;
+			_snapshot.interval_switches = _interval_switches;
+			_snapshot.interval_ticks = now - _interval_start;
+			_snapshot.suppressible_ticks = _suppressible_ticks;
+			_snapshot.nr_quanta_expired = _nr_quanta_expired;
+			_snapshot.nr_quanta_yielded = _nr_quanta_yielded;
+			_snapshot.nr_affinity_picks = _nr_affinity_picks;
+			_snapshot.wait_latency = _wait_latency;
+			_snapshot.slice_length = _slice_length;
+			_snapshot.runqueue_length = _runqueue_length;
+			_snapshot.pick_cycles = _pick_cycles;
+			_snapshot.quantum_use = _quantum_use;
+			_snapshot.nr_entities = 0;
+			_snapshot.nr_unlisted = 0;
+			_snapshot.policy[0] = 0;
+
+			__atomic_store_n(&_pending, true, __ATOMIC_RELEASE);
+
+			_interval_switches = 0;
+			_interval_start = now;
+		}
+
+		/**
+		 * Adds the entities on some rings to the snapshot.
+		 */
+		void snapshot_entities(const RunqueueRing *rings, unsigned int nr_rings) {
+			for (unsigned int i = 0; i < nr_rings; i++) {
+				RunqueueNode *node = rings[i].head();
+				if (node == NULL) continue;
+
+				do {
+					snapshot_entity(node);
+					node = node->next;
+				} while (node != rings[i].head());
+			}
+		}
+
+		/**
+		 * Adds the entities on a heap to the snapshot.
+		 */
+		void snapshot_entities(const NodeHeap& heap) {
+			for (unsigned int i = 0; i < heap.count(); i++) {
+				snapshot_entity(heap.at(i));
+			}
+		}
+
+		/**
+		 * Adds one entity to the snapshot.
+		 * @param deadline_misses The number of deadlines the entity has missed, for policies with deadlines.
+		 */
+		void snapshot_entity(const RunqueueNode *node, uint64_t deadline_misses = 0) {
+			if (_snapshot.nr_entities == SCHED_STATS_MAX_ENTITIES) {
+				_snapshot.nr_unlisted++;
+				return;
+			}
+
+			EntitySnapshot& entry = _snapshot.entities[_snapshot.nr_entities++];
+			entry.entity = (uint64_t) node->entity;
+			entry.level = node->level;
+			entry.nr_runs = node->nr_runs;
+			entry.wait_total = node->wait_total;
+			entry.key = node->key;
+			entry.weight = node->weight;
+			entry.deadline_misses = deadline_misses;
+		}
+
+		/**
+		 * Adds the policy's own state to the snapshot, as key=value pairs.
+		 */
+		void snapshot_policy(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+			va_list args;
+
+			va_start(args, format);
+			infos::util::vsnprintf(_snapshot.policy, sizeof(_snapshot.policy), format, args);
+			va_end(args);
+		}
+
+		/**
+		 * Writes the last snapshot to the debug log, if it has not been written yet.  Must be
+		 * called without the runqueue lock held, and only from the pick.  Most picks have
+		 * nothing to write, and return before taking the lock; otherwise the snapshot is
+		 * copied out under the lock, and formatted and logged after it is released.
+		 */
+		void flush() {
+			if (!__atomic_load_n(&_pending, __ATOMIC_ACQUIRE)) return;
+
+			{
+				infos::util::UniqueIRQLock l;
+				if (!_pending) return;
+
+				_flushing = _snapshot;
+				_pending = false;
+			}
+
+			const Snapshot& snapshot = _flushing;
+
+			snapshot.wait_latency.format(_wait_text, sizeof(_wait_text));
+			snapshot.slice_length.format(_slice_text, sizeof(_slice_text));
+			snapshot.runqueue_length.format(_length_text, sizeof(_length_text));
+			snapshot.pick_cycles.format(_cycles_text, sizeof(_cycles_text));
+			snapshot.quantum_use.format(_quantum_text, sizeof(_quantum_text));
+
+			infos::kernel::syslog.messagef(infos::kernel::LogLevel::DEBUG,
+				"sched-stats: sched=%s enqueues=%lu picks=%lu switches=%lu interval_switches=%lu interval_ticks=%lu suppressible_ticks=%lu quanta_expired=%lu quanta_yielded=%lu affinity_picks=%lu entities_unlisted=%u wait_hist=%s slice_hist=%s rq_len_hist=%s pick_cycles_hist=%s quantum_use_hist=%s",
+				_scheduler_name, snapshot.nr_enqueues, snapshot.nr_picks, snapshot.nr_switches, snapshot.interval_switches, snapshot.interval_ticks,
+				snapshot.suppressible_ticks, snapshot.nr_quanta_expired, snapshot.nr_quanta_yielded, snapshot.nr_affinity_picks, snapshot.nr_unlisted,
+				_wait_text, _slice_text, _length_text, _cycles_text, _quantum_text);
+
+			if (snapshot.policy[0] != 0) {
+				infos::kernel::syslog.messagef(infos::kernel::LogLevel::DEBUG, "sched-stats: sched=%s %s", _scheduler_name, snapshot.policy);
+			}
+
+			for (unsigned int i = 0; i < snapshot.nr_entities; i++) {
+				const EntitySnapshot& entry = snapshot.entities[i];
+
+				infos::kernel::syslog.messagef(infos::kernel::LogLevel::DEBUG,
+					"sched-stats: sched=%s entity=%lx level=%u runs=%u wait_total=%lu key=%lu weight=%lu deadline_misses=%lu",
+					_scheduler_name, entry.entity, entry.level, entry.nr_runs, entry.wait_total, entry.key, entry.weight,
+					entry.deadline_misses);
+			}
+		}
+
+	private:
+		const char *_scheduler_name;
+
+		// The node of the entity that was picked last, while it is still runnable.
+		RunqueueNode *_last;
+
+		uint64_t _nr_enqueues, _nr_picks, _nr_switches, _suppressible_ticks;
+		uint64_t _nr_quanta_expired, _nr_quanta_yielded, _nr_affinity_picks;
+		uint64_t _interval_switches, _interval_start;
+		unsigned int _until_dump;
+		uint64_t _pick_start;
+
+		Histogram _wait_latency, _slice_length, _runqueue_length, _pick_cycles, _quantum_use;
+
+		/**
+		 * The state of one entity, as of a snapshot.  What the key and weight mean
+		 * depends on the policy (e.g. pass and tickets, or deadline and quantum).
+		 */
+		struct EntitySnapshot {
+			uint64_t entity;
+			unsigned int level, nr_runs;
+			uint64_t wait_total, key, weight, deadline_misses;
+		};
+
+		/**
+		 * The statistics as of the last snapshot, waiting to be logged.
+		 */
+		struct Snapshot {
+			uint64_t nr_enqueues, nr_picks, nr_switches, interval_switches, interval_ticks;
+			uint64_t suppressible_ticks, nr_quanta_expired, nr_quanta_yielded, nr_affinity_picks;
+			Histogram wait_latency, slice_length, runqueue_length, pick_cycles, quantum_use;
+
+			EntitySnapshot entities[SCHED_STATS_MAX_ENTITIES];
+			unsigned int nr_entities, nr_unlisted;
+
+			char policy[128];
+		};
+
+		Snapshot _snapshot;
+		bool _pending;
+
+		// The snapshot being logged, and its formatted histograms.  They are kept here rather
+		// than on the stack of the pick, which is small; only one flush runs at a time.
+		Snapshot _flushing;
+		char _wait_text[256], _slice_text[256], _length_text[256], _cycles_text[256], _quantum_text[256];
+	};
+}
+
+#endif /* SCHED_STATS_H */
@@ -0,0 +1,356 @@
+/*
+ * Stride Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "runqueue.h"
+#include "sched-entity.h"
+#include "sched-params.h"
+#include "sched-stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace runqueue;
+
+// The constant that strides are derived from: an entity's stride is STRIDE_LARGE / tickets.
+#define STRIDE_LARGE (1ULL << 20)
+// The number of tickets an entity holds, unless its class has been given some other number.
+#define STRIDE_DEFAULT_TICKETS 100
+// The largest number of tickets an entity may hold.
+#define STRIDE_MAX_TICKETS STRIDE_LARGE
+// The number of ticket classes.  An entity's class is its priority, and any beyond the last class share it.
+#define STRIDE_NR_CLASSES 8
+// The level of an entity's record while its key holds the pass it had left when it last left the runqueue.
+#define STRIDE_REMAIN_SAVED 1
+
+// The tickets each entity of a class holds, or zero for STRIDE_DEFAULT_TICKETS, set from the kernel command line.
+static uint64_t stride_class_tickets[STRIDE_NR_CLASSES];
+
+/**
+ * sched.stride.tickets=<tickets> sets the tickets of every class, and sched.stride.tickets=<class>:<tickets>,...
+ * sets the tickets of particular classes.  Entries apply in order, so "100,0:400" gives each entity of
+ * class 0 four times the share of any other entity.  Tickets are between 1 and STRIDE_MAX_TICKETS.
+ */
+RegisterCmdLineArgument(StrideTickets, "sched.stride.tickets")
+{
+	const char *p = value;
+	uint64_t values[2];
+	int nr_values;
+
+	while ((nr_values = sched_params::read_entry(p, values, 2)) > 0) {
+		uint64_t tickets = values[nr_values - 1];
+		if (tickets == 0 || tickets > STRIDE_MAX_TICKETS || (nr_values == 2 && values[0] >= STRIDE_NR_CLASSES)) {
+			nr_values = -1;
+			break;
+		}
+
+		for (unsigned int i = 0; i < STRIDE_NR_CLASSES; i++) {
+			if (nr_values == 1 || values[0] == i) stride_class_tickets[i] = tickets;
+		}
+	}
+
+	if (nr_values < 0) {
+		syslog.messagef(LogLevel::WARNING, "stride: sched.stride.tickets=%s is malformed, and was only applied up to '%s'", value, p);
+	}
+}
+
+/**
+ * A stride (proportional-share) scheduling algorithm.
+ *
+ * Each entity holds a number of tickets, which are its own if it has been given some with
+ * set_parameters() (see sched-entity.h), with the values { tickets }, and otherwise come from
+ * its class (its priority).  It receives CPU time in proportion to its share of the tickets
+ * held by all runnable entities.  Every entity has a pass value, which advances by its stride
+ * (inversely proportional to its tickets) each time it runs for a scheduling event, and the
+ * entity with the lowest pass runs next, found through a min-heap in O(log n).
+ *
+ * The scheduler also keeps a global pass, which advances as if a single entity holding all of
+ * the runnable tickets were running.  When an entity leaves the runqueue, how far its pass is
+ * from the global pass is saved (its "remain"), and when it comes back it starts that far from
+ * the global pass again.  An entity that ran ahead of its share so carries the debt across a
+ * sleep, but one that is behind starts at the global pass, rather than being owed the time it
+ * was away.  A change of tickets scales the remain with the stride.
+ */
+class StrideScheduler : public SchedulingAlgorithm, public sched_entity::EntityParameters
+{
+public:
+	StrideScheduler() : stats("stride"), _current(NULL), _global_pass(0), _total_tickets(0)
+	{
+		sched_entity::register_entity_parameters(*this, *this);
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "stride"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		//Wakeups go onto a lock-free queue, and join the runqueue when the queue is next drained
+		uint64_t now = sys.runtime_ticks();
+		if (wakeups.push(&entity, now)) return;
+
+		UniqueIRQLock l;
+		enqueue_entity(entity, now);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *node = entities.lookup(&entity);
+		if (!node) return;
+
+		//Save how far the entity is from the global pass, for when it comes back
+		RunqueueNode *record = records.lookup(&entity);
+		if (!record) {
+			record = records.insert(&entity);
+			record->weight = 0;
+		}
+
+		record->key = node->key - _global_pass;
+		record->level = STRIDE_REMAIN_SAVED;
+
+		dequeue(node);
+	}
+
+	/**
+	 * Sets the parameters of an entity: { tickets }.
+	 */
+	bool set_parameters(SchedulingEntity& entity, const uint64_t *values, unsigned int count) override
+	{
+		if (count > 1) return false;
+
+		return set_tickets(entity, count == 0 ? 0 : values[0]);
+	}
+
+	/**
+	 * Gives an entity its own number of tickets, between 1 and STRIDE_MAX_TICKETS, or with zero,
+	 * goes back to the tickets of its class.  A runnable entity's share changes straight away.
+	 * @return Returns FALSE if the number of tickets is out of range.
+	 */
+	bool set_tickets(SchedulingEntity& entity, uint64_t tickets)
+	{
+		if (tickets > STRIDE_MAX_TICKETS) return false;
+
+		UniqueIRQLock l;
+
+		//The entity may still be waiting in the wakeup queue
+		drain_wakeups();
+
+		RunqueueNode *record = records.lookup(&entity);
+		if (!record) {
+			if (tickets == 0) return true;
+
+			record = records.insert(&entity);
+			record->level = 0;
+		}
+
+		uint64_t old_tickets = tickets_of(entity);
+		record->weight = tickets;
+		uint64_t new_tickets = tickets_of(entity);
+
+		RunqueueNode *node = entities.lookup(&entity);
+		if (node) {
+			//A runnable entity keeps its distance from the global pass, in units of its new stride
+			node->key = _global_pass + scale_remain(node->key - _global_pass, old_tickets, new_tickets);
+			node->weight = new_tickets;
+			passes.update(node);
+
+			_total_tickets = _total_tickets - old_tickets + new_tickets;
+		} else if (record->level == STRIDE_REMAIN_SAVED) {
+			record->key = scale_remain(record->key, old_tickets, new_tickets);
+		}
+
+		if (record->weight == 0 && record->level != STRIDE_REMAIN_SAVED) records.erase(record);
+		return true;
+	}
+
+	/**
+	 * Forgets the tickets and remain of an entity.
+	 */
+	void entity_exited(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		drain_wakeups();
+
+		//The entity should have left the runqueue already, but make sure nothing refers to it
+		RunqueueNode *node = entities.lookup(&entity);
+		if (node) dequeue(node);
+
+		RunqueueNode *record = records.lookup(&entity);
+		if (record) records.erase(record);
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		SchedulingEntity *next;
+
+		{
+			UniqueIRQLock l;
+			stats.pick_started();
+
+			drain_wakeups();
+
+			//Charge the entity that was running for this scheduling event, and advance the global pass by
+			//the stride of all the runnable tickets together
+			if (_current != NULL) {
+				_current->key += STRIDE_LARGE / _current->weight;
+				passes.update(_current);
+			}
+
+			if (_total_tickets > 0) {
+				_global_pass += STRIDE_LARGE / _total_tickets;
+			}
+
+			_current = passes.top();
+
+			stats.entity_picked(_current, entities.count());
+			if (stats.dump_due()) {
+				stats.snapshot();
+				stats.snapshot_policy("global_pass=%lu total_tickets=%lu", _global_pass, _total_tickets);
+				stats.snapshot_entities(passes);
+			}
+
+			next = _current == NULL ? NULL : _current->entity;
+		}
+
+		//Any statistics due are logged once the runqueue lock is released.
+		stats.flush();
+		return next;
+	}
+
+private:
+	/**
+	 * Adds a newly runnable entity, starting it at the global pass, or as far past it as it was
+	 * when it left the runqueue.  Must be called with the runqueue lock held.
+	 */
+	void enqueue_entity(SchedulingEntity& entity, uint64_t ready_since)
+	{
+		//An entity is only ever queued once
+		if (entities.lookup(&entity)) return;
+
+		uint64_t tickets = tickets_of(entity);
+
+		RunqueueNode *node = entities.insert(&entity);
+		node->weight = tickets;
+		node->key = _global_pass;
+
+		//Only a debt is carried over: an entity that was behind is not owed the difference
+		RunqueueNode *record = records.lookup(&entity);
+		if (record && record->level == STRIDE_REMAIN_SAVED) {
+			int64_t remain = (int64_t) record->key;
+			if (remain > 0) node->key += remain;
+
+			record->level = 0;
+			if (record->weight == 0) records.erase(record);
+		}
+
+		passes.push(node);
+		_total_tickets += tickets;
+
+		stats.entity_enqueued(node, ready_since);
+	}
+
+	/**
+	 * Takes a runnable entity off the runqueue.  Must be called with the runqueue lock held.
+	 */
+	void dequeue(RunqueueNode *node)
+	{
+		if (_current == node) _current = NULL;
+
+		passes.remove(node);
+		_total_tickets -= node->weight;
+
+		stats.entity_removed(node);
+		entities.erase(node);
+	}
+
+	/**
+	 * Returns the number of tickets an entity holds: its own, if it has been given some, or
+	 * otherwise those of its class.
+	 */
+	uint64_t tickets_of(const SchedulingEntity& entity) const
+	{
+		RunqueueNode *record = records.lookup(&entity);
+		if (record && record->weight != 0) return record->weight;
+
+		unsigned int priority = (unsigned int) entity.priority();
+		uint64_t tickets = stride_class_tickets[priority < STRIDE_NR_CLASSES ? priority : STRIDE_NR_CLASSES - 1];
+
+		return tickets == 0 ? STRIDE_DEFAULT_TICKETS : tickets;
+	}
+
+	/**
+	 * Converts a distance from the global pass, which may be negative, from strides of one
+	 * number of tickets to strides of another.
+	 */
+	static uint64_t scale_remain(uint64_t remain, uint64_t old_tickets, uint64_t new_tickets)
+	{
+		return (uint64_t) (((int64_t) remain * (int64_t) old_tickets) / (int64_t) new_tickets);
+	}
+
+	/**
+	 * Moves every entity waiting in the wakeup queue onto the runqueue, in the order they woke up.
+	 * Must be called with the runqueue lock held.
+	 */
+	void drain_wakeups()
+	{
+		SchedulingEntity *entity;
+		uint64_t ready_since;
+
+		while (wakeups.pop(entity, ready_since)) {
+			enqueue_entity(*entity, ready_since);
+		}
+	}
+
+	// Runnable entities, ordered on pass, and the table that finds an entity's node.
+	NodeHeap passes;
+	EntityTable entities;
+
+	// What is kept for an entity whether it is runnable or not, until it exits: its own tickets
+	// in the weight, or zero, and its remain in the key, while the level is STRIDE_REMAIN_SAVED.
+	EntityTable records;
+
+	// Entities that have woken up, but have not yet been added to the runqueue.
+	WakeupQueue wakeups;
+
+	// Latency and runqueue instrumentation.
+	SchedStats stats;
+
+	// The node of the entity chosen at the last pick, if it is still runnable.
+	RunqueueNode *_current;
+
+	uint64_t _global_pass;
+	// The tickets held by all runnable entities.
+	uint64_t _total_tickets;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(StrideScheduler);
@@ -0,0 +1,42 @@
+/*
+ * Adaptive Preemption Tick Registry
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#include <infos/kernel/sched.h>
+#include <infos/util/lock.h>
+
+#include "sched-tick.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+namespace sched_tick {
+	//The list of scheduling algorithms that can tell when they need the tick
+	static PreemptionTicks *preemption_ticks_head = NULL;
+
+	/**
+	 * Registers the preemption ticks of a scheduling algorithm, so that the tick path can find them.
+	 */
+	void register_preemption_ticks(SchedulingAlgorithm& algorithm, PreemptionTicks& ticks)
+	{
+		UniqueIRQLock l;
+
+		ticks._algorithm = &algorithm;
+		ticks._next = preemption_ticks_head;
+		preemption_ticks_head = &ticks;
+	}
+
+	PreemptionTicks *preemption_ticks_of(const SchedulingAlgorithm& algorithm)
+	{
+		UniqueIRQLock l;
+
+		for (PreemptionTicks *ticks = preemption_ticks_head; ticks != NULL; ticks = ticks->_next) {
+			if (ticks->_algorithm == &algorithm) return ticks;
+		}
+
+		return NULL;
+	}
+}
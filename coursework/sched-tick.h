@@ -0,0 +1,55 @@
+/*
+ * Adaptive Preemption Tick Interface
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SCHED_TICK_H
+#define SCHED_TICK_H
+
+#include <infos/kernel/sched.h>
+
+namespace sched_tick {
+
+	/**
+	 * A scheduling algorithm that can tell when the periodic timer tick has nothing to do.
+	 * After each pick, the tick path asks whether it needs the next tick, and if not, it can
+	 * stop the periodic tick and let the picked entity run undisturbed:
+	 *
+	 *   PreemptionTicks *ticks = preemption_ticks_of(algorithm);    // once, when it is selected
+	 *   ...
+	 *   SchedulingEntity *next = algorithm.pick_next_entity();
+	 *   if (ticks && !ticks->needs_preemption_tick()) ...stop the tick...
+	 *
+	 * The tick must be started again, with a pick, as soon as anything is added to or removed
+	 * from the runqueue, since only a pick takes the change into account.
+	 */
+	class PreemptionTicks {
+		friend void register_preemption_ticks(infos::kernel::SchedulingAlgorithm& algorithm, PreemptionTicks& ticks);
+		friend PreemptionTicks *preemption_ticks_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+
+	public:
+		PreemptionTicks() : _algorithm(NULL), _next(NULL) { }
+
+		/**
+		 * Returns TRUE if the timer needs to interrupt the entity that was picked last, so
+		 * that the next pick happens on time.
+		 */
+		virtual bool needs_preemption_tick() const = 0;
+
+	private:
+		const infos::kernel::SchedulingAlgorithm *_algorithm;
+		PreemptionTicks *_next;
+	};
+
+	void register_preemption_ticks(infos::kernel::SchedulingAlgorithm& algorithm, PreemptionTicks& ticks);
+
+	/**
+	 * Returns the preemption ticks of a scheduling algorithm, or NULL if it has none, in which
+	 * case it needs every tick.
+	 */
+	PreemptionTicks *preemption_ticks_of(const infos::kernel::SchedulingAlgorithm& algorithm);
+}
+
+#endif /* SCHED_TICK_H */
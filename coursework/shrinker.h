@@ -0,0 +1,57 @@
+/*
+ * Memory Reclaim Interface
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef SHRINKER_H
+#define SHRINKER_H
+
+#include <infos/define.h>
+
+namespace reclaim {
+
+	/**
+	 * A cache that can give memory back to the page allocator when it runs low.  The
+	 * page allocator calls shrink() on registered shrinkers, in registration order,
+	 * when free memory drops below its watermark or when an allocation is about to fail.
+	 */
+	class Shrinker {
+		friend void register_shrinker(Shrinker& shrinker);
+		friend uint64_t shrink_caches(uint64_t nr_pages);
+
+	public:
+		Shrinker() : _next_shrinker(NULL), _registered(false) { }
+
+		/**
+		 * Releases memory held by the cache.  This may be called from inside the page
+		 * allocator (possibly on behalf of the kernel heap), so it must not allocate or
+		 * free heap memory itself: only pages taken from the page allocator can be given
+		 * back, by freeing them to it directly.
+		 * @param nr_pages The number of pages the allocator would like back.
+		 * @return Returns the number of pages actually released.
+		 */
+		virtual uint64_t shrink(uint64_t nr_pages) = 0;
+
+	private:
+		Shrinker *_next_shrinker;
+		bool _registered;
+	};
+
+	/**
+	 * Counters describing reclaim activity.
+	 */
+	struct ReclaimStats {
+		uint64_t reclaim_runs;
+		uint64_t reclaimed_pages;
+		uint64_t allocation_stalls;
+	};
+
+	extern ReclaimStats reclaim_stats;
+
+	void register_shrinker(Shrinker& shrinker);
+	uint64_t shrink_caches(uint64_t nr_pages);
+}
+
+#endif /* SHRINKER_H */
@@ -8,56 +8,31 @@
  * 
  */
 #include "tarfs.h"
+#include <infos/kernel/kernel.h>
 #include <infos/kernel/log.h>
+#include <infos/mm/mm.h>
+#include <infos/util/lock.h>
+#include <infos/assert.h>
 
 
 using namespace infos::fs;
 using namespace infos::drivers;
 using namespace infos::drivers::block;
 using namespace infos::kernel;
+using namespace infos::mm;
 using namespace infos::util;
 using namespace tarfs;
 
 #define DIRECTORY_FLAG '5'
+#define PAX_EXTENDED_FLAG 'x'
+#define PAX_GLOBAL_FLAG 'g'
 
+// The most blocks of a pax extended header that are read.  Real headers hold a handful of
+// short records, so anything larger is either padding or corrupt.
+#define TARFS_MAX_PAX_BLOCKS 16
+// The most bytes a single read or transfer moves, so that the count it returns fits in an int.
+#define TARFS_MAX_IO_SIZE (1UL << 30)
 
-/**
- * TAR files contain header data encoded as octal values in ASCII.  This function
- * converts this terrible representation into a real unsigned integer.
- *
- * You DO NOT need to modify this function.
- *
- * @param data The (null-terminated) ASCII data containing an octal number.
- * @return Returns an unsigned integer number, corresponding to the input data.
- */
-static inline unsigned int octal2ui(const char *data)
-{
-	// Current working value.
-	unsigned int value = 0;
-
-	// Length of the input data.
-	int len = strlen(data);
-
-	// Starting at i = 1, with a factor of one.
-	int i = 1, factor = 1;
-	while (i < len) {
-		// Extract the current character we're working on (backwards from the end).
-		char ch = data[len - i];
-
-		// Add the value of the character, multipled by the factor, to
-		// the working value.
-		value += factor * (ch - '0');
-		
-		// Increment the factor by multiplying it by eight.
-		factor *= 8;
-		
-		// Increment the current character position.
-		i++;
-	}
-
-	// Return the current working value.
-	return value;
-}
 
 // The structure that represents the header block present in
 // TAR files.  A header block occurs before every file, this
@@ -87,6 +62,199 @@ namespace tarfs {
 	} __packed;
 }
 
+/**
+ * Returns TRUE if every byte in the 64-bit word is an ASCII octal digit ('0' to '7').
+ * The octal digits are exactly the bytes whose top five bits are 00110.
+ */
+static inline bool is_octal_word(uint64_t word)
+{
+	return (word & 0xF8F8F8F8F8F8F8F8ULL) == 0x3030303030303030ULL;
+}
+
+/**
+ * Converts eight ASCII octal digits, loaded little-endian into a 64-bit word (so the
+ * most significant digit is in the lowest byte), into their 24-bit value.  The digits
+ * are combined pairwise, then in fours, then in eights, so there is no per-digit loop.
+ */
+static inline uint64_t octal_word_value(uint64_t word)
+{
+	uint64_t digits = word - 0x3030303030303030ULL;
+
+	// Combine neighbouring digits into 6-bit values, one per 16-bit lane.
+	digits = ((digits & 0x0007000700070007ULL) << 3) | ((digits >> 8) & 0x0007000700070007ULL);
+	// Combine neighbouring lanes into 12-bit values, one per 32-bit lane.
+	digits = ((digits & 0x0000003F0000003FULL) << 6) | ((digits >> 16) & 0x0000003F0000003FULL);
+	// Combine the two halves into the final 24-bit value.
+	return ((digits & 0xFFF) << 12) | ((digits >> 32) & 0xFFF);
+}
+
+/**
+ * TAR files contain header data encoded as octal values in ASCII.  This function
+ * converts this terrible representation into a real unsigned integer.
+ *
+ * Fields are fixed-width, and may be padded with leading spaces and terminated by
+ * a space or NUL (or not terminated at all, if every byte is a digit).  Runs of
+ * eight digits are converted a word at a time; any tail is converted one digit at
+ * a time.
+ *
+ * @param data The ASCII data containing an octal number.
+ * @param len The width of the field, in bytes.
+ * @return Returns an unsigned integer number, corresponding to the input data.
+ */
+static inline uint64_t octal2ui(const char *data, size_t len)
+{
+	size_t i = 0;
+
+	// Skip any leading padding.
+	while (i < len && data[i] == ' ') i++;
+
+	uint64_t value = 0;
+
+	// Convert eight digits at a time, for as long as there are eight digits left.
+	while (i + 8 <= len) {
+		uint64_t word;
+		memcpy(&word, &data[i], sizeof(word));
+
+		if (!is_octal_word(word)) break;
+
+		value = (value << 24) | octal_word_value(word);
+		i += 8;
+	}
+
+	// Convert the remaining digits, stopping at the terminator.
+	while (i < len && data[i] >= '0' && data[i] <= '7') {
+		value = (value << 3) | (data[i] - '0');
+		i++;
+	}
+
+	return value;
+}
+
+/**
+ * Parses a numeric header field.  Values that fit are stored as octal ASCII, but GNU
+ * tar (and pax-compatible writers) store larger values, such as member sizes of 8GiB
+ * and above, in base-256: the top bit of the first byte is set, and the remaining
+ * bits form a big-endian two's complement number.
+ * @param data The header field.
+ * @param len The width of the field, in bytes.
+ * @return Returns the value of the field.  Negative base-256 values are not
+ * meaningful for any field we use, and are returned as zero.
+ */
+static uint64_t parse_numeric_field(const char *data, size_t len)
+{
+	const uint8_t *bytes = (const uint8_t *) data;
+
+	if (!(bytes[0] & 0x80)) {
+		return octal2ui(data, len);
+	}
+
+	// The sign is carried in the second-highest bit of the first byte.
+	if (bytes[0] & 0x40) return 0;
+
+	// Only the low 64 bits can be represented, which is all any real archive needs.
+	uint64_t value = bytes[0] & 0x3F;
+	for (size_t i = 1; i < len; i++) {
+		value = (value << 8) | bytes[i];
+	}
+
+	return value;
+}
+
+/**
+ * Looks for a "size" record in the data of a pax extended header.  Each record has the
+ * form "<length> <key>=<value>\n", where length counts the whole record.
+ * @param data The contents of the extended header.
+ * @param len The number of valid bytes in data.
+ * @param size Receives the size, if a record was found.
+ * @return Returns TRUE if a valid size record was found.
+ */
+static bool parse_pax_size(const char *data, size_t len, uint64_t& size)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		// Parse the record length.
+		size_t record_len = 0, i = pos;
+		while (i < len && data[i] >= '0' && data[i] <= '9') {
+			record_len = (record_len * 10) + (data[i] - '0');
+			i++;
+		}
+
+		// Stop at anything malformed, including the zero padding at the end of the data.
+		if (record_len == 0 || i >= len || data[i] != ' ' || pos + record_len > len) break;
+		i++;
+
+		size_t record_end = pos + record_len - 1;
+		if (i + 5 < record_end && data[i] == 's' && data[i + 1] == 'i' && data[i + 2] == 'z' && data[i + 3] == 'e' && data[i + 4] == '=') {
+			uint64_t value = 0;
+			for (i += 5; i < record_end && data[i] >= '0' && data[i] <= '9'; i++) {
+				value = (value * 10) + (data[i] - '0');
+			}
+
+			size = value;
+			return true;
+		}
+
+		pos += record_len;
+	}
+
+	return false;
+}
+
+/**
+ * Sums the bytes of a 512-byte header, eight bytes at a time.  Bytes are accumulated
+ * into four 16-bit lanes per word, which cannot overflow for a single header
+ * (64 words * 2 bytes * 255 < 65536), and the lanes are added together at the end.
+ * @param header The header block to sum.
+ * @return Returns the unsigned sum of every byte in the header block.
+ */
+static inline unsigned int header_byte_sum(const posix_header *header)
+{
+	const uint8_t *bytes = (const uint8_t *) header;
+	uint64_t lanes = 0;
+
+	for (unsigned int i = 0; i < 512; i += 8) {
+		uint64_t word;
+		memcpy(&word, &bytes[i], sizeof(word));
+
+		lanes += (word & 0x00FF00FF00FF00FFULL) + ((word >> 8) & 0x00FF00FF00FF00FFULL);
+	}
+
+	lanes = (lanes & 0x0000FFFF0000FFFFULL) + ((lanes >> 16) & 0x0000FFFF0000FFFFULL);
+	return (unsigned int) ((lanes & 0xFFFFFFFF) + (lanes >> 32));
+}
+
+/**
+ * Verifies the checksum of a header block.  The checksum is the sum of every byte in
+ * the header, with the checksum field itself taken to be eight spaces.  Some historic
+ * implementations summed signed bytes, so that variant is accepted too.
+ * @param header The header block to verify.
+ * @return Returns TRUE if the stored checksum matches the header contents.
+ */
+static bool verify_header_checksum(const posix_header *header)
+{
+	unsigned int stored = (unsigned int) octal2ui(header->chksum, sizeof(header->chksum));
+
+	// Replace the contribution of the stored checksum field with eight spaces.
+	unsigned int field_sum = 0, high_bytes = 0;
+	for (unsigned int i = 0; i < sizeof(header->chksum); i++) {
+		field_sum += (uint8_t) header->chksum[i];
+	}
+
+	unsigned int unsigned_sum = header_byte_sum(header) - field_sum + (8 * ' ');
+	if (unsigned_sum == stored) return true;
+
+	// Fall back to the signed variant, which only differs for bytes >= 0x80.
+	const uint8_t *bytes = (const uint8_t *) header;
+	for (unsigned int i = 0; i < 512; i++) {
+		// Skip the checksum field (bytes 148 to 155).
+		if (i >= 148 && i < 156) continue;
+		if (bytes[i] & 0x80) high_bytes++;
+	}
+
+	return (unsigned_sum - (high_bytes * 256)) == stored;
+}
+
 /**
  * Reads the contents of the file into the buffer, from the specified file offset.
  * @param buffer The buffer to read the data into.
@@ -96,74 +264,80 @@ namespace tarfs {
  */
 int TarFSFile::pread(void* buffer, size_t size, off_t off)
 {
-	if (off >= this->size()) return 0;
-	
+	if (off < 0 || (uint64_t) off >= this->size()) return 0;
+
+	//Larger requests are satisfied in part, as a short read, since the count is returned as an int
+	if (size > TARFS_MAX_IO_SIZE) {
+		size = TARFS_MAX_IO_SIZE;
+	}
+
 	// buffer is a pointer to the buffer that should receive the data.
 	// size is the amount of data to read from the file.
 	// off is the zero-based offset within the file to start reading from.
 
-	//number of bytes in a block
-	size_t block_size = _owner.block_device().block_size();
-	//The size of file to be processed
-	auto file_size_to_process = this->size();
+	//Never read past the end of the file, even though its last block is padded out with zeroes
+	if (size > this->size() - off) {
+		size = this->size() - off;
+	}
 
-	//Optimisation: If the size of the buffer is 0 or the file is empty, then simply return that 0 bytes will be read
-	if(size == 0 || file_size_to_process == 0) return 0;
-	
-	//Convert the void type of the buffer into uint8_t and store a pointer to it in ubuffer
-	uint8_t * ubuffer = (uint8_t *) buffer;
+	//Optimisation: If the size of the buffer is 0, then simply return that 0 bytes will be read
+	if (size == 0) return 0;
 
-	//Initialise a temporary different buffer to store the blocks to be read
-	uint8_t *current_data_block = new uint8_t[block_size];
+	//The position in the archive (in bytes) that corresponds to the offset within the file.
+	//The file data starts at _file_start_block, which is the block after the file's header
+	uint64_t archive_pos = (_file_start_block * _owner.archive_block_size()) + off;
 
+	_owner.read_data(archive_pos, (uint8_t *) buffer, size);
 
-	//Given a file and the offset within the file, determine the corresponding block to read from. 
-	//i.e) If a file contains data blocks numbered A B C of size  512 bytes each (ignoring the header because _file_start_block starts after the header block)
-	//we determine which block corresponds to the offset bytes given to start reading from
-	auto block_index = (unsigned int) (off/block_size);
+	return size;
+}
 
-	//Read the blocks from the archive into the temporary current_data_block
-	//The archive is read depending on where the file is stored in the archive (set by _file_start_block) in addition to starting_block found previously, which relates to the offset to start reading from
-	_owner.block_device().read_blocks(current_data_block, (this->_file_start_block)+block_index, 1);
+/**
+ * Transfers the contents of the file, from the specified file offset, to another file or
+ * device.  The data is written to the destination straight out of the chunk cache, so
+ * unlike a read/write loop there is no intermediate buffer and no copy through user space.
+ * @param dest The file to write the data to.
+ * @param size The number of bytes to transfer.
+ * @param off The offset within this file to start transferring from.
+ * @return Returns the number of bytes transferred, which is less than size if the end of
+ * the file was reached or the destination accepted fewer bytes.
+ */
+int TarFSFile::send_to(File& dest, size_t size, off_t off)
+{
+	if (off < 0 || (uint64_t) off >= this->size()) return 0;
 
-	//index refers to the block index which we would read from the file inside archive. start index is first determined by the offset
-	int index_file = off%block_size;
-	//index refers to the buffer that would recieve the data
-	int index_buffer=0;
-	//stores number of bytes that have been read so far (moved from archive to buffer)
-	int bytes_read=0;
-
-	//Retrieve the number of blocks the current file has to make sure we dont read over the limit (even if we dont reach the size of the buffer limit)
-	auto number_of_file_blocks = _owner.get_number_of_data_blocks(this->_hdr, block_size);
-	//Read while storing things in buffer until the bytes read reaches the size of the buffer
-	while(bytes_read<size){
-		//Store the value found in the data block into buffer
-		ubuffer[index_buffer] = current_data_block[index_file];
-		//Increment the values for next iteration
-		index_file++;
-		index_buffer++;
-		//Increment number of bytes read
-		bytes_read++;
-		//If the current index refering to current_data_block from the archive is divisble by the size of the block, that means we have reached the end of that block
-		//In that case, we must proceed to the next block
-		if (index_file%block_size == 0){
-			//Reset index_file to 0 to start from the beginning of that block
-			index_file=0;
-			//Next block to read from
-			block_index++;
-			//In case the next block is not part of the current file, break from the loop as we should not be reading the next file
-			if(block_index >= number_of_file_blocks){
-				break;
-			}
-			//We must read from archive the next block into current_data_block in order to access it and store it in buffer. 
-			_owner.block_device().read_blocks(current_data_block,(this->_file_start_block)+block_index,1);
-		}
+	if (size > TARFS_MAX_IO_SIZE) {
+		size = TARFS_MAX_IO_SIZE;
+	}
+
+	if (size > this->size() - off) {
+		size = this->size() - off;
 	}
 
-	//Make sure that the block number does not exceed the amount of blocks the current file has.
-	assert(block_index < number_of_file_blocks);
+	uint64_t archive_pos = (_file_start_block * _owner.archive_block_size()) + off;
+
+	return _owner.send_data(archive_pos, dest, size);
+}
+
+/**
+ * Returns the page of this file at the given index, reading it in if it is not already
+ * cached.  The page is shared with every other open file (and mapping) of the same node.
+ * Each successful call must be balanced by a call to unmap_page().
+ * @param page_index The index of the page within the file.
+ * @return Returns the page descriptor of the page, or NULL if the index is past the end of the file.
+ */
+PageDescriptor *TarFSFile::map_page(uint64_t page_index)
+{
+	return _node.get_page(page_index);
+}
 
-	return bytes_read;
+/**
+ * Releases a page returned by map_page().
+ * @param page_index The index of the page within the file.
+ */
+void TarFSFile::unmap_page(uint64_t page_index)
+{
+	_node.put_page(page_index);
 }
 
 /**
@@ -178,18 +352,22 @@ TarFSNode* TarFS::build_tree()
 	// You must read the TAR file, and build a tree of TarFSNodes that represents each file present in the archive.
 	
 	//Get the total number of blocks in the archive
-	size_t nr_blocks = block_device().block_count();
+	size_t nr_blocks = archive_block_count();
 	//Get the size of one block in bytes
-	size_t block_size = block_device().block_size();
+	size_t block_size = archive_block_size();
 
 
 	//Define a parent; point to root first
 	TarFSNode *parent_node = root;
 
 	//Define the number of blocks to skip over to reach the next header. Will be changed depending on number of blocks current file/directory has
-	int block_increment = 0;
+	uint64_t block_increment = 0;
+
+	//A size taken from a pax extended header, which overrides the size field of the entry that follows it
+	bool has_pax_size = false;
+	uint64_t pax_size = 0;
 
-	for (int block_index=0;block_index<nr_blocks; block_index+=block_increment){
+	for (uint64_t block_index=0;block_index<nr_blocks; block_index+=block_increment){
 		//If the next two blocks are zero blocks, that means we have reached the end of archive
 		if (check_end_of_archive(block_index,nr_blocks,block_size)){
 			break;
@@ -197,10 +375,60 @@ TarFSNode* TarFS::build_tree()
 
 		//Store header information by reading the archive
 		auto header =(struct posix_header *) new char[block_size];
-		block_device().read_blocks(header,block_index,1);
+		read_archive_blocks(header,block_index,1);
 
+		//Refuse to interpret a corrupt header: everything after it would be built from garbage offsets
+		if (!verify_header_checksum(header)) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: bad header checksum at block %lu, ignoring rest of archive", block_index);
+			delete[] (char *) header;
+			break;
+		}
+
+		//Parse the size once here, so that nodes (and files opened from them) never need to look at the header again
+		uint64_t file_size = parse_numeric_field(header->size, sizeof(header->size));
 		//Get the number of blocks the current file/directory uses in an archive
-		int num_of_data_blocks = get_number_of_data_blocks(header,block_size);
+		uint64_t num_of_data_blocks = get_number_of_data_blocks(file_size,block_size);
+
+		bool is_pax_header = header->typeflag == PAX_EXTENDED_FLAG || header->typeflag == PAX_GLOBAL_FLAG;
+
+		//A pax size record takes precedence over the (possibly truncated) size field
+		if (has_pax_size && !is_pax_header) {
+			file_size = pax_size;
+			num_of_data_blocks = get_number_of_data_blocks(file_size, block_size);
+			has_pax_size = false;
+		}
+
+		//An entry whose data runs past the end of the device has a corrupt size, and so does everything after it
+		if (num_of_data_blocks > nr_blocks - block_index - 1) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: entry at block %lu runs past the end of the archive, ignoring rest of archive", block_index);
+			delete[] (char *) header;
+			break;
+		}
+
+		//Extended headers describe the entry that follows them, and are not entries themselves
+		if (is_pax_header) {
+			if (header->typeflag == PAX_EXTENDED_FLAG && num_of_data_blocks > 0) {
+				//Only the start of an oversized header is read; records beyond it are ignored
+				uint64_t nr_pax_blocks = num_of_data_blocks;
+				if (nr_pax_blocks > TARFS_MAX_PAX_BLOCKS) {
+					nr_pax_blocks = TARFS_MAX_PAX_BLOCKS;
+				}
+
+				size_t pax_len = nr_pax_blocks * block_size;
+				if (pax_len > file_size) {
+					pax_len = file_size;
+				}
+
+				auto pax_data = new char[nr_pax_blocks * block_size];
+				read_archive_blocks(pax_data, block_index + 1, nr_pax_blocks);
+				has_pax_size = parse_pax_size(pax_data, pax_len, pax_size);
+				delete[] pax_data;
+			}
+
+			block_increment = num_of_data_blocks + 1;
+			delete[] (char *) header;
+			continue;
+		}
 
 
 		//Reset and point the parent node to go back to the root
@@ -222,15 +450,21 @@ TarFSNode* TarFS::build_tree()
 				//Add a new node with the corresponding name under the current parent node
 				TarFSNode *child = new TarFSNode(parent_node, (pathing.at(index)), *this);
 				parent_node->add_child(pathing.at(index),child);
+				_stats.nodes++;
 
 				//If the last node is not a directory and we have reached the end of the pathing name, mark it as a file by setting the block offset
 				if (header->typeflag!=DIRECTORY_FLAG && nodes_count == index + 1 ){
 					//Sets where the block header of the file is 
 					child->set_block_offset(block_index);
+					_stats.files++;
 				}	
-				//Set the corresponding size
-				child->size(octal2ui(header->size));	
+				//Set the corresponding size.  Directories created on the way to the entry have none of their own
+				if (nodes_count == index + 1) {
+					child->size(file_size);
+				}
 
+				//Carry on down into the new node, so that the rest of the path is created under it
+				parent_node = child;
 				index++;
 			}
 			else { 	
@@ -241,9 +475,11 @@ TarFSNode* TarFS::build_tree()
 		}
 		//Adjust increment size of the huge loop to go to the next header corresponding to the next file/directory to add to the tree
 		block_increment=num_of_data_blocks + 1;
+		_stats.entries++;
+		_stats.archive_blocks = block_index + block_increment;
 
 		// Delete the header structure of the current file/directory
-		delete header;
+		delete[] (char *) header;
 	
 	}
 
@@ -251,19 +487,553 @@ TarFSNode* TarFS::build_tree()
 }
 
 
+/**
+ * Works out what kind of archive is on the device, and how it is laid out.  A device that
+ * starts with an LZ4 frame holds a compressed archive, which is indexed here so that any
+ * part of it can be read by decompressing just the block that holds it.  Anything else is
+ * taken to be a raw archive.
+ * @return Returns FALSE if the archive cannot be read, in which case it appears empty.
+ */
+bool TarFS::open_archive()
+{
+	size_t block_size = block_device().block_size();
+
+	_compressed = false;
+	_chunk_size = block_size * TARFS_CHUNK_BLOCKS;
+	_archive_blocks = block_device().block_count();
+
+	uint8_t frame_header[LZ4_MAX_FRAME_HEADER_SIZE];
+	bool ok = true;
+
+	if (block_device().block_count() * block_size >= sizeof(frame_header) && read_device(0, frame_header, sizeof(frame_header))
+		&& lz4::read_le32(frame_header) == LZ4_FRAME_MAGIC) {
+		lz4::FrameInfo info;
+
+		if (!lz4::parse_frame_header(frame_header, sizeof(frame_header), info)) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: unsupported lz4 frame (only independent blocks, without a dictionary, can be read)");
+			ok = false;
+		} else {
+			_compressed = true;
+			_chunk_size = info.block_max_size;
+
+			// A block can start part way into a device block, and end part way into another.
+			{
+				UniqueLock<Mutex> l(_scratch_lock);
+				reserve_scratch(info.block_max_size + (2 * block_size));
+			}
+
+			ok = index_compressed_archive(info);
+		}
+
+		if (!ok) _archive_blocks = 0;
+	}
+
+	// Hold fewer chunks when they are large, so that the cache stays a sensible size.
+	_nr_chunks = TARFS_MAX_CACHE_SIZE / _chunk_size;
+	if (_nr_chunks > TARFS_NR_CACHED_CHUNKS) _nr_chunks = TARFS_NR_CACHED_CHUNKS;
+	if (_nr_chunks < TARFS_MIN_CACHED_CHUNKS) _nr_chunks = TARFS_MIN_CACHED_CHUNKS;
+
+	return ok;
+}
+
+/**
+ * Builds the seek index of a compressed archive, by walking the block headers of its LZ4
+ * frame.  Each block decompresses to one chunk of the archive, and every block but the
+ * last is full, so the chunk holding any position is found by dividing by the block size.
+ * @param info The parameters of the frame.
+ * @return Returns FALSE if the frame is truncated or malformed.
+ */
+bool TarFS::index_compressed_archive(const lz4::FrameInfo& info)
+{
+	uint64_t device_size = block_device().block_count() * block_device().block_size();
+	uint64_t pos = info.header_size;
+	uint64_t capacity = 16;
+
+	_lz4_blocks = new CompressedBlock[capacity];
+	_nr_lz4_blocks = 0;
+
+	while (true) {
+		uint8_t size_word[4];
+		if (pos + sizeof(size_word) > device_size || !read_device(pos, size_word, sizeof(size_word))) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: lz4 frame is truncated at byte %lu", pos);
+			return false;
+		}
+
+		uint32_t block_size = lz4::read_le32(size_word);
+		pos += sizeof(size_word);
+
+		// A zero size word marks the end of the frame.
+		if (block_size == 0) break;
+
+		uint32_t stored_size = block_size & ~LZ4_BLOCK_UNCOMPRESSED;
+		if (stored_size > info.block_max_size || pos + stored_size > device_size) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: bad lz4 block at byte %lu", pos - sizeof(size_word));
+			return false;
+		}
+
+		if (_nr_lz4_blocks == capacity) {
+			auto blocks = new CompressedBlock[capacity * 2];
+			memcpy(blocks, _lz4_blocks, capacity * sizeof(CompressedBlock));
+			delete[] _lz4_blocks;
+
+			_lz4_blocks = blocks;
+			capacity *= 2;
+		}
+
+		_lz4_blocks[_nr_lz4_blocks].offset = pos;
+		_lz4_blocks[_nr_lz4_blocks].size = block_size;
+		_nr_lz4_blocks++;
+
+		// Block checksums are skipped, not verified.
+		pos += stored_size + (info.block_checksums ? 4 : 0);
+	}
+
+	// The length of the archive is the full blocks, plus however much the last one holds.
+	uint64_t archive_size = 0;
+	if (_nr_lz4_blocks > 0) {
+		auto last = new uint8_t[chunk_size()];
+		archive_size = ((_nr_lz4_blocks - 1) * chunk_size()) + load_chunk(_nr_lz4_blocks - 1, last);
+		delete[] last;
+	}
+
+	// A frame written with flushes has short blocks in the middle, which would throw every
+	// later position off.  That can only be told from the recorded content size, if there is one.
+	if (info.has_content_size && info.content_size != archive_size) {
+		syslog.messagef(LogLevel::ERROR, "tarfs: lz4 frame has short blocks (content size %lu, indexed %lu)", info.content_size, archive_size);
+		return false;
+	}
+
+	_archive_blocks = archive_size / TARFS_BLOCK_SIZE;
+	return true;
+}
+
+/**
+ * Reads bytes straight off the device, at any alignment, by reading the device blocks
+ * that cover them.
+ * @param device_pos The position on the device, in bytes.
+ * @param buffer The buffer to read into.
+ * @param size The number of bytes to read.
+ * @return Returns FALSE if the range runs past the end of the device.
+ */
+bool TarFS::read_device(uint64_t device_pos, uint8_t *buffer, size_t size)
+{
+	UniqueLock<Mutex> l(_scratch_lock);
+
+	const uint8_t *data = read_device_scratch(device_pos, size);
+	if (data == NULL) return false;
+
+	memcpy(buffer, data, size);
+	return true;
+}
+
+/**
+ * Reads the device blocks that cover a range of bytes into the scratch buffer.  Must be
+ * called with the scratch lock held, and the data is only valid until it is released.
+ * @param device_pos The position on the device, in bytes.
+ * @param size The number of bytes to read.
+ * @return Returns a pointer to the bytes in the scratch buffer, or NULL if the range runs
+ * past the end of the device.
+ */
+const uint8_t *TarFS::read_device_scratch(uint64_t device_pos, size_t size)
+{
+	size_t block_size = block_device().block_size();
+
+	uint64_t first_block = device_pos / block_size;
+	uint64_t end_block = (device_pos + size + block_size - 1) / block_size;
+	if (end_block > block_device().block_count()) return NULL;
+
+	reserve_scratch((end_block - first_block) * block_size);
+	block_device().read_blocks(_scratch, first_block, end_block - first_block);
+
+	return _scratch + (device_pos % block_size);
+}
+
+/**
+ * Grows the scratch buffer to at least the given size.  Must be called with the scratch
+ * lock held.
+ */
+void TarFS::reserve_scratch(size_t size)
+{
+	if (size <= _scratch_size) return;
+
+	delete[] _scratch;
+	_scratch = new uint8_t[size];
+	_scratch_size = size;
+}
+
+/**
+ * Reads whole blocks of the archive, in archive_block_size() units.
+ * @param buffer The buffer to read into.
+ * @param block_index The first block to read.
+ * @param nr_blocks The number of blocks to read.
+ */
+void TarFS::read_archive_blocks(void *buffer, uint64_t block_index, size_t nr_blocks)
+{
+	if (!_compressed) {
+		block_device().read_blocks(buffer, block_index, nr_blocks);
+		return;
+	}
+
+	read_data(block_index * TARFS_BLOCK_SIZE, (uint8_t *) buffer, nr_blocks * TARFS_BLOCK_SIZE);
+}
+
+/**
+ * Copies data out of the archive, starting at the given byte position.
+ * @param archive_pos The position in the archive, in bytes, to start reading from.
+ * @param buffer The buffer to read the data into.
+ * @param size The number of bytes to read.
+ */
+void TarFS::read_data(uint64_t archive_pos, uint8_t *buffer, size_t size)
+{
+	//number of bytes in a block, and in a cached chunk of blocks
+	size_t block_size = block_device().block_size();
+
+	//stores number of bytes that have been read so far (moved from archive to buffer)
+	size_t bytes_read = 0;
+
+	//Copy a chunk at a time, so a read only touches the chunks that overlap the requested range
+	while (bytes_read < size) {
+		//Once the read is block-aligned and at least a chunk remains, transfer whole blocks straight
+		//into the caller's buffer.  This issues one device request per run of blocks instead of one
+		//per chunk, skips the intermediate copy, and keeps large streaming reads from evicting the cache.
+		size_t remaining = size - bytes_read;
+		//A compressed archive has no blocks on the device to transfer, so always goes through the cache.
+		if (!_compressed && archive_pos % block_size == 0 && remaining >= chunk_size()) {
+			size_t nr_blocks = remaining / block_size;
+			if (nr_blocks > TARFS_MAX_DIRECT_BLOCKS) {
+				nr_blocks = TARFS_MAX_DIRECT_BLOCKS;
+			}
+
+			block_device().read_blocks(buffer + bytes_read, archive_pos / block_size, nr_blocks);
+			__atomic_fetch_add(&_stats.direct_blocks, nr_blocks, __ATOMIC_RELAXED);
+
+			bytes_read += nr_blocks * block_size;
+			archive_pos += nr_blocks * block_size;
+			continue;
+		}
+
+		uint64_t chunk_index = archive_pos / chunk_size();
+		size_t chunk_offset = archive_pos % chunk_size();
+
+		//Copy up to the end of this chunk, or the end of the request, whichever comes first
+		size_t amount = chunk_size() - chunk_offset;
+		if (amount > remaining) {
+			amount = remaining;
+		}
+
+		copy_from_chunk(chunk_index, chunk_offset, buffer + bytes_read, amount);
+
+		bytes_read += amount;
+		archive_pos += amount;
+	}
+}
+
+/**
+ * Writes data from the archive, starting at the given byte position, to a file.
+ * @param archive_pos The position in the archive, in bytes, to start from.
+ * @param dest The file to write the data to.
+ * @param size The number of bytes to write.
+ * @return Returns the number of bytes the destination accepted.
+ */
+size_t TarFS::send_data(uint64_t archive_pos, File& dest, size_t size)
+{
+	size_t bytes_sent = 0;
+	uint8_t *temp = NULL;
+
+	while (bytes_sent < size) {
+		uint64_t chunk_index = archive_pos / chunk_size();
+		size_t chunk_offset = archive_pos % chunk_size();
+
+		size_t amount = chunk_size() - chunk_offset;
+		if (amount > size - bytes_sent) {
+			amount = size - bytes_sent;
+		}
+
+		//Write straight out of the cached chunk, keeping it pinned for the duration of the write
+		int rc;
+		CachedChunk *chunk = pin_chunk(chunk_index);
+		if (chunk != NULL) {
+			rc = dest.write(chunk->data + chunk_offset, amount);
+			unpin_chunk(chunk);
+		} else {
+			//The chunk cannot be cached right now, so stage it in a private buffer instead
+			if (temp == NULL) {
+				temp = new uint8_t[chunk_size()];
+			}
+
+			load_chunk(chunk_index, temp);
+			rc = dest.write(temp + chunk_offset, amount);
+		}
+
+		if (rc <= 0) break;
+
+		bytes_sent += rc;
+		archive_pos += rc;
+
+		//A short write means the destination can't take any more right now
+		if ((size_t) rc < amount) break;
+	}
+
+	if (temp != NULL) {
+		delete[] temp;
+	}
+
+	return bytes_sent;
+}
+
+/**
+ * Reads a chunk of the archive from the block device.  All reads of file data that go
+ * through the cache end up here, so this is the one place that maps a position in the
+ * archive to where it is stored on the device: for a raw archive this is just
+ * index * TARFS_CHUNK_BLOCKS, and for a compressed archive it is the LZ4 block of the
+ * same index, which is decompressed into the buffer.
+ * @param chunk_index The index of the chunk to read.
+ * @param buffer The buffer to read the chunk into, which must be chunk_size() bytes.
+ * Anything past the end of the archive is zero-filled.
+ * @return Returns the number of bytes of the archive that the chunk holds.
+ */
+size_t TarFS::load_chunk(uint64_t chunk_index, uint8_t *buffer)
+{
+	if (!_compressed) {
+		//The last chunk of the archive may be short
+		uint64_t first_block = chunk_index * TARFS_CHUNK_BLOCKS;
+		size_t nr_blocks = TARFS_CHUNK_BLOCKS;
+		if (first_block + nr_blocks > block_device().block_count()) {
+			nr_blocks = block_device().block_count() - first_block;
+		}
+
+		block_device().read_blocks(buffer, first_block, nr_blocks);
+		return nr_blocks * block_device().block_size();
+	}
+
+	long length = 0;
+
+	if (chunk_index < _nr_lz4_blocks) {
+		const CompressedBlock& block = _lz4_blocks[chunk_index];
+		size_t stored_size = block.size & ~LZ4_BLOCK_UNCOMPRESSED;
+
+		//Blocks that did not compress are stored as they are, and are read straight into the chunk
+		if (block.size & LZ4_BLOCK_UNCOMPRESSED) {
+			if (read_device(block.offset, buffer, stored_size)) length = stored_size;
+		} else {
+			//Compressed blocks are decompressed straight out of the scratch buffer
+			UniqueLock<Mutex> l(_scratch_lock);
+
+			const uint8_t *compressed = read_device_scratch(block.offset, stored_size);
+			if (compressed != NULL) {
+				length = lz4::decompress_block(compressed, stored_size, buffer, chunk_size());
+			}
+		}
+
+		//Only the last block may be short; a short block anywhere else means everything after it is misplaced
+		if (length < 0 || ((size_t) length < chunk_size() && chunk_index + 1 < _nr_lz4_blocks)) {
+			__atomic_fetch_add(&_stats.decompress_errors, 1, __ATOMIC_RELAXED);
+			syslog.messagef(LogLevel::ERROR, "tarfs: corrupt lz4 block %lu", chunk_index);
+			length = 0;
+		}
+	}
+
+	memset(buffer + length, 0, chunk_size() - length);
+	return length;
+}
+
+/**
+ * Looks up a chunk of the archive in the chunk cache, reading it from the block device
+ * if it is not present, and pins it so that it cannot be replaced while it is in use.
+ * When the cache is full, the least recently used unpinned chunk is replaced.
+ *
+ * The cache lock only covers the cache metadata: it is never held across the device
+ * read or the copy out of the chunk, so a reader that blocks on the device does not hold
+ * up readers of other chunks.  The cache lock is a UniqueIRQLock, which only excludes the
+ * local CPU.  That is sufficient because InfOS runs on a single CPU, where readers only
+ * interleave by being preempted; it would not be if readers ran on several CPUs at once.
+ *
+ * @param chunk_index The index of the chunk to retrieve.
+ * @return Returns the pinned cache entry holding the chunk, or NULL if the chunk is
+ * currently being read in by someone else, or every entry is pinned.
+ */
+TarFS::CachedChunk *TarFS::pin_chunk(uint64_t chunk_index)
+{
+	CachedChunk *victim = NULL;
+	bool dump = false;
+
+	{
+		UniqueIRQLock l;
+
+		for (unsigned int i = 0; i < _nr_chunks; i++) {
+			CachedChunk *candidate = &_chunks[i];
+
+			if (candidate->valid && candidate->index == chunk_index) {
+				if (candidate->loading) return NULL;
+
+				_stats.chunk_hits++;
+				candidate->refcount++;
+				candidate->last_used = ++_chunk_clock;
+				return candidate;
+			}
+
+			//Prefer an empty entry, otherwise the unpinned one that was used longest ago
+			if (candidate->refcount > 0) continue;
+			if (victim == NULL || (victim->valid && (!candidate->valid || candidate->last_used < victim->last_used))) {
+				victim = candidate;
+			}
+		}
+
+		if (victim == NULL) return NULL;
+
+		_stats.chunk_misses++;
+		dump = (_stats.chunk_misses % TARFS_STATS_DUMP_INTERVAL) == 0;
+
+		//Claim the entry.  Until loading is cleared, only this reader touches its data.
+		victim->index = chunk_index;
+		victim->valid = true;
+		victim->loading = true;
+		victim->refcount = 1;
+	}
+
+	if (victim->data == NULL) {
+		PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(chunk_order());
+
+		//Without memory for the entry, give it up, and let the caller read around the cache
+		if (pgd == NULL) {
+			UniqueIRQLock l;
+			victim->valid = false;
+			victim->loading = false;
+			victim->refcount = 0;
+			return NULL;
+		}
+
+		victim->pgd = pgd;
+		victim->data = (uint8_t *) sys.mm().pgalloc().pgd_to_vpa(pgd);
+	}
+
+	load_chunk(chunk_index, victim->data);
+
+	{
+		UniqueIRQLock l;
+		victim->loading = false;
+		victim->last_used = ++_chunk_clock;
+	}
+
+	//Report how reads are being served every so often, outside the lock
+	if (dump) dump_stats();
+
+	return victim;
+}
+
+/**
+ * Releases a chunk pinned by pin_chunk().
+ * @param chunk The cache entry to release.
+ */
+void TarFS::unpin_chunk(CachedChunk *chunk)
+{
+	UniqueIRQLock l;
+
+	assert(chunk->refcount > 0);
+	chunk->refcount--;
+}
+
+/**
+ * Copies data out of a chunk of the archive.
+ * @param chunk_index The index of the chunk to copy from.
+ * @param offset The offset within the chunk to start copying from.
+ * @param buffer The buffer to copy the data into.
+ * @param size The number of bytes to copy, which must not go past the end of the chunk.
+ */
+void TarFS::copy_from_chunk(uint64_t chunk_index, size_t offset, uint8_t *buffer, size_t size)
+{
+	assert(offset + size <= chunk_size());
+
+	CachedChunk *chunk = pin_chunk(chunk_index);
+
+	//If the chunk cannot be cached right now, read around the cache rather than waiting for it
+	if (chunk == NULL) {
+		__atomic_fetch_add(&_stats.chunk_bypasses, 1, __ATOMIC_RELAXED);
+
+		auto temp = new uint8_t[chunk_size()];
+		load_chunk(chunk_index, temp);
+		memcpy(buffer, temp + offset, size);
+		delete[] temp;
+		return;
+	}
+
+	memcpy(buffer, chunk->data + offset, size);
+	unpin_chunk(chunk);
+}
+
+/**
+ * Writes the mount and read statistics of this filesystem to the log, as a single line
+ * of key=value pairs, so that runs can be compared by a script rather than by eye.  This
+ * happens at mount, and then every TARFS_STATS_DUMP_INTERVAL chunk cache misses.
+ */
+void TarFS::dump_stats()
+{
+	syslog.messagef(LogLevel::INFO,
+		"tarfs: stats format=%s entries=%lu nodes=%lu files=%lu archive_blocks=%lu lz4_blocks=%lu chunk_hits=%lu chunk_misses=%lu chunk_bypasses=%lu direct_blocks=%lu decompress_errors=%lu",
+		_compressed ? "lz4" : "raw", _stats.entries, _stats.nodes, _stats.files, _stats.archive_blocks, _nr_lz4_blocks,
+		_stats.chunk_hits, _stats.chunk_misses, _stats.chunk_bypasses, _stats.direct_blocks, _stats.decompress_errors);
+}
+
+/**
+ * Gives memory back to the page allocator.  Unmapped file pages are released first,
+ * and then the pages of unpinned chunks of the chunk cache.  Anything in use is left
+ * alone.  Everything released here came from the page allocator, and goes straight
+ * back to it, so this never touches the kernel heap (which may be what is allocating).
+ * @param nr_pages The number of pages the allocator would like back.
+ * @return Returns the number of pages released.
+ */
+uint64_t TarFS::shrink(uint64_t nr_pages)
+{
+	uint64_t released = 0;
+
+	TarFSNode *node;
+	{
+		UniqueIRQLock l;
+		node = _paged_nodes;
+	}
+
+	for (; node != NULL && released < nr_pages; node = node->_next_paged) {
+		released += node->release_pages(nr_pages - released);
+	}
+
+	int order = chunk_order();
+
+	for (unsigned int i = 0; i < _nr_chunks && released < nr_pages; i++) {
+		PageDescriptor *pgd = NULL;
+
+		{
+			UniqueIRQLock l;
+
+			CachedChunk& chunk = _chunks[i];
+			if (chunk.pgd != NULL && chunk.refcount == 0 && !chunk.loading) {
+				pgd = chunk.pgd;
+				chunk.pgd = NULL;
+				chunk.data = NULL;
+				chunk.valid = false;
+			}
+		}
+
+		if (pgd != NULL) {
+			sys.mm().pgalloc().free_pages(pgd, order);
+			released += 1 << order;
+		}
+	}
+
+	return released;
+}
+
 /**
  * Given information on the size of the file, get the number of blocks a file/directory uses to store the data, apart from the header.
- * @param header The header structure of the file/directory to get size information from
+ * @param file_size The size in bytes of the file/directory, as parsed from its header
  * @param block_size The size of each block in archive
  * @return the number of blocks corresponding to the size of the file after the header
  **/
-int TarFS::get_number_of_data_blocks(posix_header* header, size_t block_size){
-	unsigned int num = 0;
-	unsigned int file_size = octal2ui(header->size);
+uint64_t TarFS::get_number_of_data_blocks(uint64_t file_size, size_t block_size){
+	uint64_t num = 0;
 	if (file_size % block_size != 0){
 		num+=1;
 	}
-	num+= (unsigned int) (file_size/block_size);
+	num+= file_size/block_size;
 	return num;
 }
 
@@ -275,31 +1045,20 @@ int TarFS::get_number_of_data_blocks(posix_header* header, size_t block_size){
  * @param block_size The size of each block in archive
  * @return True if the next two blocks are zero blocks
  **/
-bool TarFS::check_end_of_archive(int block_index, size_t nr_blocks, size_t block_size){
+bool TarFS::check_end_of_archive(uint64_t block_index, size_t nr_blocks, size_t block_size){
 	if (block_index<nr_blocks){		
-		//Read the next two blocks
+		//Read the next two blocks, or just the last one, treating anything past the end as zero
 		auto temp= new uint8_t[block_size * 2];
-		block_device().read_blocks(temp,block_index,2);
+		memset(temp, 0, block_size * 2);
+		read_archive_blocks(temp,block_index,block_index + 1 < nr_blocks ? 2 : 1);
 		//Determine whether the temp buffer are all zeros
 		bool result = (is_zero_block(temp,block_size*2));
-		delete temp;
+		delete[] temp;
 		return result; 
 	}
 	return false;
 }
 
-
-/**
- * Returns the size of this TarFS File
- */
-unsigned int TarFSFile::size() const
-{
-	// TO BE FILLED IN
-	//
-	return octal2ui(_hdr->size);
-
-}
-
 /* --- YOU DO NOT NEED TO CHANGE ANYTHING BELOW THIS LINE --- */
 
 /**
@@ -310,7 +1069,12 @@ PFSNode *TarFS::mount()
 {
 	// If the root node has not been generated, then build it.
 	if (_root_node == NULL) {
+		open_archive();
 		_root_node = build_tree();
+		dump_stats();
+
+		// Let the page allocator take back cached data when memory runs low.
+		reclaim::register_shrinker(*this);
 	}
 
 	// Return the root node.
@@ -318,28 +1082,22 @@ PFSNode *TarFS::mount()
 }
 
 /**
- * Constructs a TarFS File object, given the owning file system and the block
+ * Constructs a TarFS File object, given the owning file system and the node
+ * it was opened from.  The node already carries everything that was parsed
+ * from the header at mount time, so no I/O is needed here.
  */
-TarFSFile::TarFSFile(TarFS& owner, unsigned int file_header_block)
-: _hdr(NULL),
-_owner(owner),
-_file_start_block(file_header_block),
+TarFSFile::TarFSFile(TarFS& owner, TarFSNode& node)
+: _owner(owner),
+_node(node),
+_file_start_block(node.block_offset() + 1),
+_size(node.size()),
 _cur_pos(0)
 {
-	// Allocate storage for the header.
-	_hdr = (struct posix_header *) new char[_owner.block_device().block_size()];
-	
-	// Read the header block into the header structure.
-	_owner.block_device().read_blocks(_hdr, _file_start_block, 1);
-	
-	// Increment the starting block for file data.
-	_file_start_block++;
+	// The data blocks start immediately after the header block.
 }
 
 TarFSFile::~TarFSFile()
 {
-	// Delete the header structure that was allocated in the constructor.
-	delete _hdr;
 }
 
 /**
@@ -363,13 +1121,20 @@ int TarFSFile::read(void* buffer, size_t size)
 	// current position indicator, so just delegate actual processing to
 	// pread, and update internal state accordingly.
 
+	// The position is the only mutable state in a TarFSFile.  It is locked for the
+	// whole read, so that threads sharing the open file each read a different part
+	// of it, rather than reading the same part and then both advancing past the next.
+	UniqueLock<Mutex> l(_pos_lock);
+
 	// Perform the read from the current file position.
 	int rc = pread(buffer, size, _cur_pos);
 
 	// Increment the current file position by the number of bytes that was read.
 	// The number of bytes actually read may be less than 'size', so it's important
 	// we only advance the current position by the actual number of bytes read.
-	_cur_pos += rc;
+	if (rc > 0) {
+		_cur_pos += rc;
+	}
 
 	// Return the number of bytes read.
 	return rc;
@@ -385,6 +1150,8 @@ int TarFSFile::read(void* buffer, size_t size)
  */
 void TarFSFile::seek(off_t offset, SeekType type)
 {
+	UniqueLock<Mutex> l(_pos_lock);
+
 	// If this is an absolute seek, then set the current file position
 	// to the given offset (subject to the file size).  There should
 	// probably be a way to return an error if the offset was out of bounds.
@@ -398,7 +1165,7 @@ void TarFSFile::seek(off_t offset, SeekType type)
 	}
 }
 
-TarFSNode::TarFSNode(TarFSNode *parent, const String& name, TarFS& owner) : PFSNode(parent, owner), _name(name), _size(0), _has_block_offset(false), _block_offset(0)
+TarFSNode::TarFSNode(TarFSNode *parent, const String& name, TarFS& owner) : PFSNode(parent, owner), _first_child(NULL), _last_child(NULL), _next_sibling(NULL), _pages(NULL), _next_paged(NULL), _name(name), _size(0), _has_block_offset(false), _block_offset(0)
 {
 }
 
@@ -418,8 +1185,144 @@ File* TarFSNode::open()
 		return NULL;
 	}
 
-	// Create a new file object, with a header from this node's block offset.
-	return new TarFSFile((TarFS&) owner(), _block_offset);
+	// Create a new file object, from the metadata cached in this node.
+	return new TarFSFile((TarFS&) owner(), *this);
+}
+
+/**
+ * Returns a page of this file's contents, reading it in on first use.  Tar data is only
+ * 512-byte aligned within the archive, so the archive blocks cannot be mapped directly:
+ * instead each page is assembled once, and then shared read-only by everyone mapping the file.
+ * The tail of the last page is zero-filled.
+ * @param page_index The index of the page within the file.
+ * @return Returns the page descriptor of the page, with its reference count raised, or NULL
+ * if this node is not a file or the index is past the end of the file.
+ */
+PageDescriptor *TarFSNode::get_page(uint64_t page_index)
+{
+	if (!_has_block_offset) return NULL;
+
+	uint64_t nr_pages = (_size + TARFS_PAGE_SIZE - 1) / TARFS_PAGE_SIZE;
+	if (page_index >= nr_pages) return NULL;
+
+	// The page table is only allocated for files that are actually mapped.  It is
+	// built outside the lock, and discarded if another mapper installed one first.
+	// It is published with release ordering, so whoever sees it also sees it initialised.
+	if (__atomic_load_n(&_pages, __ATOMIC_ACQUIRE) == NULL) {
+		auto pages = new CachedPage[nr_pages];
+		for (uint64_t i = 0; i < nr_pages; i++) {
+			pages[i].pgd = NULL;
+			pages[i].refcount = 0;
+		}
+
+		TarFS& fs = (TarFS&) owner();
+
+		UniqueIRQLock l;
+		if (_pages == NULL) {
+			__atomic_store_n(&_pages, pages, __ATOMIC_RELEASE);
+			pages = NULL;
+
+			//Page tables are never taken down, so the node stays on the list for good
+			_next_paged = fs._paged_nodes;
+			fs._paged_nodes = this;
+		}
+
+		if (pages != NULL) delete[] pages;
+	}
+
+	CachedPage& page = _pages[page_index];
+
+	{
+		UniqueIRQLock l;
+		if (page.pgd != NULL) {
+			page.refcount++;
+			return page.pgd;
+		}
+	}
+
+	// Fill the page without holding the lock, since this may need to go to the device.
+	PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(0);
+	if (pgd == NULL) return NULL;
+
+	uint8_t *data = (uint8_t *) sys.mm().pgalloc().pgd_to_vpa(pgd);
+
+	TarFS& fs = (TarFS&) owner();
+	uint64_t file_offset = page_index * TARFS_PAGE_SIZE;
+	uint64_t archive_pos = ((_block_offset + 1) * fs.archive_block_size()) + file_offset;
+
+	size_t amount = TARFS_PAGE_SIZE;
+	if (amount > _size - file_offset) {
+		amount = _size - file_offset;
+	}
+
+	fs.read_data(archive_pos, data, amount);
+	memset(data + amount, 0, TARFS_PAGE_SIZE - amount);
+
+	// If another mapper filled the same page in the meantime, use theirs and drop ours.
+	PageDescriptor *result;
+	{
+		UniqueIRQLock l;
+		if (page.pgd == NULL) {
+			page.pgd = pgd;
+			pgd = NULL;
+		}
+
+		page.refcount++;
+		result = page.pgd;
+	}
+
+	if (pgd != NULL) {
+		sys.mm().pgalloc().free_pages(pgd, 0);
+	}
+
+	return result;
+}
+
+/**
+ * Drops a reference to a page returned by get_page().  The page stays cached, so that the
+ * next mapping of the file finds it already populated.
+ * @param page_index The index of the page within the file.
+ */
+void TarFSNode::put_page(uint64_t page_index)
+{
+	UniqueIRQLock l;
+
+	assert(_pages != NULL && _pages[page_index].refcount > 0);
+	_pages[page_index].refcount--;
+}
+
+/**
+ * Releases cached pages of this node that are not currently mapped.  Released pages
+ * are read in again if they are mapped later.
+ * @param nr_pages The maximum number of pages to release.
+ * @return Returns the number of pages released.
+ */
+uint64_t TarFSNode::release_pages(uint64_t nr_pages)
+{
+	uint64_t released = 0;
+
+	if (_pages != NULL) {
+		uint64_t nr_cached_pages = (_size + TARFS_PAGE_SIZE - 1) / TARFS_PAGE_SIZE;
+
+		for (uint64_t i = 0; i < nr_cached_pages && released < nr_pages; i++) {
+			PageDescriptor *pgd = NULL;
+
+			{
+				UniqueIRQLock l;
+				if (_pages[i].pgd != NULL && _pages[i].refcount == 0) {
+					pgd = _pages[i].pgd;
+					_pages[i].pgd = NULL;
+				}
+			}
+
+			if (pgd != NULL) {
+				sys.mm().pgalloc().free_pages(pgd, 0);
+				released++;
+			}
+		}
+	}
+
+	return released;
 }
 
 /**
@@ -441,7 +1344,8 @@ PFSNode* TarFSNode::get_child(const String& name)
 	TarFSNode *child;
 
 	// Try to find the given child node in the children map, and return
-	// NULL if it wasn't found.
+	// NULL if it wasn't found.  The tree is only modified by build_tree(),
+	// before the root node is published by mount(), so lookups need no lock.
 	if (!_children.try_get_value(name.get_hash(), child)) {
 		return NULL;
 	}
@@ -466,7 +1370,7 @@ PFSNode* TarFSNode::mkdir(const String& name)
  * that contains the header of the file that this node represents.
  * @param offset The block offset that corresponds to this node.
  */
-void TarFSNode::set_block_offset(unsigned int offset)
+void TarFSNode::set_block_offset(uint64_t offset)
 {
 	_has_block_offset = true;
 	_block_offset = offset;
@@ -474,40 +1378,61 @@ void TarFSNode::set_block_offset(unsigned int offset)
 
 /**
  * A helper routine that adds a child node to the internal children
- * map of this node.
+ * map of this node, and appends it to the list of siblings used for
+ * directory enumeration.
  * @param name The name of the child node.
  * @param child The actual child node.
  */
 void TarFSNode::add_child(const String& name, TarFSNode *child)
 {
 	_children.add(name.get_hash(), child);
+
+	if (_last_child == NULL) {
+		_first_child = child;
+	} else {
+		_last_child->_next_sibling = child;
+	}
+
+	_last_child = child;
 }
 
-TarFSDirectory::TarFSDirectory(TarFSNode& node) : _entries(NULL), _nr_entries(0), _cur_entry(0)
+/**
+ * Opens a directory for enumeration.  The tree is immutable once mounted, so the
+ * directory simply walks the node's children in place rather than copying them.
+ */
+TarFSDirectory::TarFSDirectory(TarFSNode& node) : _next_child(node.first_child())
 {
-	_nr_entries = node.children().count();
-	_entries = new DirectoryEntry[_nr_entries];
-
-	int i = 0;
-	for (const auto& child : node.children()) {
-		_entries[i].name = child.value->name();
-		_entries[i++].size = child.value->size();
-	}
 }
 
 TarFSDirectory::~TarFSDirectory()
 {
-	delete _entries;
 }
 
 bool TarFSDirectory::read_entry(infos::fs::DirectoryEntry& entry)
 {
-	if (_cur_entry < _nr_entries) {
-		entry = _entries[_cur_entry++];
-		return true;
-	} else {
-		return false;
+	return read_entries(&entry, 1) == 1;
+}
+
+/**
+ * Reads a batch of directory entries.
+ * @param entries The array to fill in.
+ * @param count The number of entries in the array.
+ * @return Returns the number of entries filled in, which is zero once the
+ * directory has been exhausted.
+ */
+unsigned int TarFSDirectory::read_entries(infos::fs::DirectoryEntry *entries, unsigned int count)
+{
+	unsigned int nr_read = 0;
+
+	while (nr_read < count && _next_child != NULL) {
+		entries[nr_read].name = _next_child->name();
+		entries[nr_read].size = _next_child->size();
+
+		nr_read++;
+		_next_child = _next_child->next_sibling();
 	}
+
+	return nr_read;
 }
 
 void TarFSDirectory::close()
@@ -16,12 +16,35 @@
 
 #include <infos/drivers/block/block-device.h>
 
+#include <infos/mm/page-allocator.h>
+
+#include "shrinker.h"
+#include "lz4.h"
+
 #include <infos/util/string.h>
 #include <infos/util/map.h>
 #include <infos/util/list.h>
+#include <infos/util/lock.h>
 
 #define DIRECTORY_FLAG '5'
 
+// The size of a tar block.  Raw archives are addressed in device blocks, which are the same size.
+#define TARFS_BLOCK_SIZE 512
+// The number of archive blocks that make up one cached chunk (4KiB with 512-byte blocks).
+#define TARFS_CHUNK_BLOCKS 8
+// The most chunks held in the chunk cache.
+#define TARFS_NR_CACHED_CHUNKS 64
+// The fewest chunks held in the chunk cache, however large chunks are.
+#define TARFS_MIN_CACHED_CHUNKS 4
+// The most memory the chunk cache holds, which limits the number of entries used for large chunks.
+#define TARFS_MAX_CACHE_SIZE (16UL << 20)
+// The largest number of blocks transferred by a single direct (uncached) read.
+#define TARFS_MAX_DIRECT_BLOCKS 256
+// The number of chunk cache misses between reports of the filesystem statistics.
+#define TARFS_STATS_DUMP_INTERVAL 1024
+// The size of the pages that mapped files are cached in.
+#define TARFS_PAGE_SIZE 4096
+
 namespace tarfs {
 
 	class TarFSNode;
@@ -29,13 +52,24 @@ namespace tarfs {
 
 	struct posix_header;
 
-	class TarFS : public infos::fs::BlockBasedFilesystem {
+	class TarFS : public infos::fs::BlockBasedFilesystem, public reclaim::Shrinker {
 		friend class TarFSNode;
 		friend class TarFSFile;
 
 	public:
 
-		TarFS(infos::drivers::block::BlockDevice& bdev) : BlockBasedFilesystem(bdev), _root_node(NULL) {
+		TarFS(infos::drivers::block::BlockDevice& bdev) : BlockBasedFilesystem(bdev), _root_node(NULL), _paged_nodes(NULL), _nr_chunks(0), _chunk_clock(0),
+			_compressed(false), _chunk_size(0), _archive_blocks(0), _lz4_blocks(NULL), _nr_lz4_blocks(0),
+			_scratch(NULL), _scratch_size(0) {
+			memset(&_stats, 0, sizeof(_stats));
+
+			for (unsigned int i = 0; i < TARFS_NR_CACHED_CHUNKS; i++) {
+				_chunks[i].pgd = NULL;
+				_chunks[i].data = NULL;
+				_chunks[i].refcount = 0;
+				_chunks[i].valid = false;
+				_chunks[i].loading = false;
+			}
 		}
 
 		infos::fs::PFSNode *mount() override;
@@ -44,11 +78,30 @@ namespace tarfs {
 			return "tarfs";
 		}
 
+		void dump_stats();
+
+		uint64_t shrink(uint64_t nr_pages) override;
+
 	private:
+		bool open_archive();
+		bool index_compressed_archive(const lz4::FrameInfo& info);
 		TarFSNode *build_tree();
 		
+		/**
+		 * Returns TRUE if the buffer is entirely zero.  The bulk of the buffer is
+		 * tested 32 bytes at a time, by OR-ing four words together.
+		 */
 		static bool is_zero_block(const uint8_t *buffer, size_t size = 512) {
-			for (unsigned int i = 0; i < size; i++) {
+			unsigned int i = 0;
+
+			for (; i + 32 <= size; i += 32) {
+				uint64_t words[4];
+				memcpy(words, &buffer[i], sizeof(words));
+
+				if ((words[0] | words[1] | words[2] | words[3]) != 0) return false;
+			}
+
+			for (; i < size; i++) {
 				if (buffer[i] != 0) return false;
 			}
 
@@ -57,16 +110,113 @@ namespace tarfs {
 
 		TarFSNode *_root_node;
 
+		// The nodes that have a page table, most recently mapped first, so that reclaim
+		// only visits nodes that can have pages to give back.
+		TarFSNode *_paged_nodes;
+
+		/**
+		 * An entry in the chunk cache.  A chunk is chunk_size() consecutive bytes of the archive,
+		 * identified by its index: for a raw archive, TARFS_CHUNK_BLOCKS blocks, and for a
+		 * compressed archive, the contents of one LZ4 block.
+		 * Entries with a non-zero refcount are in use by a reader, and are never replaced.
+		 * The data of a chunk lives in pages taken straight from the page allocator, so that
+		 * the shrinker can hand them back without going through the kernel heap.
+		 */
+		struct CachedChunk {
+			uint64_t index;
+			uint64_t last_used;
+			infos::mm::PageDescriptor *pgd;
+			uint8_t *data;
+			unsigned int refcount;
+			bool valid;
+			bool loading;
+		};
+
+		CachedChunk _chunks[TARFS_NR_CACHED_CHUNKS];
+		unsigned int _nr_chunks;
+		uint64_t _chunk_clock;
+
+		/**
+		 * Where a block of a compressed archive is stored on the device.  The size is the
+		 * stored size word of the block, so it includes the LZ4_BLOCK_UNCOMPRESSED flag.
+		 */
+		struct CompressedBlock {
+			uint64_t offset;
+			uint32_t size;
+		};
+
+		// Whether the archive is an LZ4 frame, rather than raw tar blocks.
+		bool _compressed;
+		size_t _chunk_size;
+		uint64_t _archive_blocks;
+
+		// The seek index of a compressed archive: one entry per LZ4 block, in archive order.
+		CompressedBlock *_lz4_blocks;
+		uint64_t _nr_lz4_blocks;
+
+		// The buffer that unaligned device reads and compressed blocks are read into, and the
+		// lock held while it is in use.  It only ever grows, and a compressed archive sizes it
+		// for its largest block when it is opened, so reads do not allocate.
+		uint8_t *_scratch;
+		size_t _scratch_size;
+		infos::util::Mutex _scratch_lock;
+
+		/**
+		 * Counters describing the archive that was mounted, and how reads were served.
+		 */
+		struct {
+			uint64_t entries, nodes, files, archive_blocks;
+			uint64_t chunk_hits, chunk_misses, chunk_bypasses, direct_blocks;
+			uint64_t decompress_errors;
+		} _stats;
+
+		size_t chunk_size() const {
+			return _chunk_size;
+		}
+
+		/**
+		 * Returns the size of the blocks that archive positions are counted in.  A compressed
+		 * archive is addressed in tar blocks of its decompressed contents.
+		 */
+		size_t archive_block_size() {
+			return _compressed ? TARFS_BLOCK_SIZE : block_device().block_size();
+		}
+
+		uint64_t archive_block_count() const {
+			return _archive_blocks;
+		}
+
+		/**
+		 * Returns the order of the page allocation that holds one chunk.
+		 */
+		int chunk_order() {
+			int order = 0;
+			while (((size_t) TARFS_PAGE_SIZE << order) < chunk_size()) order++;
+
+			return order;
+		}
+
+		bool read_device(uint64_t device_pos, uint8_t *buffer, size_t size);
+		const uint8_t *read_device_scratch(uint64_t device_pos, size_t size);
+		void reserve_scratch(size_t size);
+		void read_archive_blocks(void *buffer, uint64_t block_index, size_t nr_blocks);
+		void read_data(uint64_t archive_pos, uint8_t *buffer, size_t size);
+		size_t send_data(uint64_t archive_pos, infos::fs::File& dest, size_t size);
+		size_t load_chunk(uint64_t chunk_index, uint8_t *buffer);
+		CachedChunk *pin_chunk(uint64_t chunk_index);
+		void unpin_chunk(CachedChunk *chunk);
+		void copy_from_chunk(uint64_t chunk_index, size_t offset, uint8_t *buffer, size_t size);
+
 		//Student-defined:
-		int get_number_of_data_blocks(posix_header* header, size_t block_size);
-		bool check_end_of_archive(int block_index, size_t nr_blocks, size_t block_size);
+		uint64_t get_number_of_data_blocks(uint64_t file_size, size_t block_size);
+		bool check_end_of_archive(uint64_t block_index, size_t nr_blocks, size_t block_size);
 
 	};
 
 	class TarFSFile : public infos::fs::File {
 	public:
 
-		TarFSFile(TarFS& owner, unsigned int file_header_block);
+		TarFSFile(TarFS& owner, TarFSNode& node);
 		virtual ~TarFSFile();
 
 		void close() override;
@@ -80,14 +230,27 @@ namespace tarfs {
 		}
 
 		void seek(off_t offset, SeekType type) override;
+
+		int send_to(infos::fs::File& dest, size_t size, off_t off);
 		
-		unsigned int size() const;
+		/**
+		 * Returns the size of this file, as parsed from its header at mount time.
+		 */
+		uint64_t size() const {
+			return _size;
+		}
 
-	private:
-		struct posix_header *_hdr;
+		infos::mm::PageDescriptor *map_page(uint64_t page_index);
+		void unmap_page(uint64_t page_index);
 
+	private:
 		TarFS& _owner;
-		unsigned int _file_start_block, _cur_pos;
+		TarFSNode& _node;
+		uint64_t _file_start_block, _size;
+
+		// The current position, and the lock that read() and seek() hold while they use it.
+		uint64_t _cur_pos;
+		infos::util::Mutex _pos_lock;
 	};
 
 	class TarFSDirectory : public infos::fs::Directory {
@@ -96,14 +259,16 @@ namespace tarfs {
 		virtual ~TarFSDirectory();
 
 		bool read_entry(infos::fs::DirectoryEntry& entry) override;
+		unsigned int read_entries(infos::fs::DirectoryEntry *entries, unsigned int count);
 		void close() override;
 
 	private:
-		infos::fs::DirectoryEntry *_entries;
-		unsigned int _nr_entries, _cur_entry;
+		const TarFSNode *_next_child;
 	};
 
 	class TarFSNode : public infos::fs::PFSNode {
+		friend class TarFS;
+
 	public:
 		typedef infos::util::Map<infos::util::String::hash_type, TarFSNode *> TarFSNodeMap;
 
@@ -117,7 +282,15 @@ namespace tarfs {
 
 		PFSNode* mkdir(const infos::util::String& name) override;
 
-		void set_block_offset(unsigned int offset);
+		void set_block_offset(uint64_t offset);
+
+		bool has_block_offset() const {
+			return _has_block_offset;
+		}
+
+		uint64_t block_offset() const {
+			return _block_offset;
+		}
 
 		void add_child(const infos::util::String& name, TarFSNode *child);
 
@@ -125,24 +298,51 @@ namespace tarfs {
 			return _children;
 		}
 
+		/**
+		 * Returns the first child of this node, in archive order.  The remaining children
+		 * are reached through next_sibling(), so they can be walked without a snapshot.
+		 */
+		const TarFSNode *first_child() const {
+			return _first_child;
+		}
+
+		const TarFSNode *next_sibling() const {
+			return _next_sibling;
+		}
+
 		const infos::util::String& name() const {
 			return _name;
 		}
 
-		unsigned int size() const {
+		uint64_t size() const {
 			return _size;
 		}
 
-		void size(unsigned int size) {
+		void size(uint64_t size) {
 			_size = size;
 		}
 
+		infos::mm::PageDescriptor *get_page(uint64_t page_index);
+		void put_page(uint64_t page_index);
+		uint64_t release_pages(uint64_t nr_pages);
+
 	private:
+		/**
+		 * A page of file data, shared by every mapping of this node.
+		 */
+		struct CachedPage {
+			infos::mm::PageDescriptor *pgd;
+			unsigned int refcount;
+		};
+
 		TarFSNodeMap _children;
+		TarFSNode *_first_child, *_last_child, *_next_sibling;
+		CachedPage *_pages;
+		TarFSNode *_next_paged;
 		const infos::util::String _name;
-		unsigned int _size;
+		uint64_t _size;
 		bool _has_block_offset;
-		unsigned int _block_offset;
+		uint64_t _block_offset;
 	};
 }
 
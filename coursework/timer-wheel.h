@@ -0,0 +1,166 @@
+/*
+ * Scheduler Timer Wheel
+ */
+
+/*
+ * STUDENT NUMBER: s1870697
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "runqueue.h"
+
+// The number of bits of the expiry time each level of a timer wheel covers.
+#define TIMER_WHEEL_LEVEL_BITS 6
+// The number of slots in each level of a timer wheel.
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+// The number of levels in a timer wheel.
+#define TIMER_WHEEL_LEVELS 4
+
+namespace runqueue {
+
+	/**
+	 * A hierarchical timer wheel of nodes, ordered on their key, which is the time at which
+	 * they expire.  Level 0 has one slot per tick; each level above has slots that cover a
+	 * whole turn of the level below.  A node is filed in the lowest level whose range covers
+	 * its expiry, and when a level wraps, the next slot of the level above is cascaded back
+	 * down.  Adding and removing are constant-time ring operations, and advancing by one tick
+	 * touches one slot per level at most.  Nodes further away than the top level reaches are
+	 * filed in its furthest slot, and filed again when they are cascaded.
+	 *
+	 * A node on the wheel records its slot in its heap_index.  Expired nodes are collected on
+	 * a ring, and handed back in the order they expired by pop_expired.  The wheel does not
+	 * lock: callers hold the runqueue lock.
+	 */
+	class TimerWheel {
+	public:
+		TimerWheel() : _now(0), _count(0) { }
+
+		/**
+		 * Files a node, which must not already be on the wheel, to expire at its key.  A node
+		 * that is already due expires at the next advance.
+		 */
+		void add(RunqueueNode *node) {
+			file(node);
+			_count++;
+		}
+
+		/**
+		 * Removes a node from the wheel before it has been handed back by pop_expired.
+		 */
+		void remove(RunqueueNode *node) {
+			if (node->heap_index == EXPIRED_SLOT) _expired.remove(node);
+			else _slots[node->heap_index].remove(node);
+
+			_count--;
+		}
+
+		/**
+		 * Advances the wheel to the given time, moving every node that expires by then onto
+		 * the expired ring.
+		 */
+		void advance(uint64_t now) {
+			// Nothing is waiting, so there is nothing to cascade or expire on the way.
+			if (_count == _expired.count()) {
+				if (now > _now) _now = now;
+				return;
+			}
+
+			while (_now < now) {
+				_now++;
+
+				// When a level wraps, bring the next slot of the level above down.
+				for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+					if (((_now >> ((level - 1) * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_SLOTS - 1)) != 0) break;
+					cascade(level, (_now >> (level * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_SLOTS - 1));
+				}
+
+				RunqueueRing& slot = _slots[_now & (TIMER_WHEEL_SLOTS - 1)];
+				while (!slot.empty()) {
+					RunqueueNode *node = slot.head();
+
+					slot.remove(node);
+					expire(node);
+				}
+			}
+		}
+
+		/**
+		 * Takes the node that expired first off the expired ring.
+		 * @return Returns FALSE if nothing has expired.
+		 */
+		bool pop_expired(RunqueueNode *& node) {
+			node = _expired.head();
+			if (node == NULL) return false;
+
+			_expired.remove(node);
+			_count--;
+
+			return true;
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+		bool empty() const {
+			return _count == 0;
+		}
+
+	private:
+		// The heap_index of a node that is on the expired ring.
+		static const unsigned int EXPIRED_SLOT = TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS;
+
+		/**
+		 * Puts a node in the slot that covers its expiry, relative to the current time.
+		 */
+		void file(RunqueueNode *node) {
+			if (node->key <= _now) {
+				expire(node);
+				return;
+			}
+
+			uint64_t delta = node->key - _now;
+			unsigned int level = 0;
+
+			while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_LEVEL_BITS))) {
+				level++;
+			}
+
+			// Beyond the reach of the top level, the node waits in its furthest slot.
+			uint64_t expires = node->key;
+			uint64_t reach = 1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS);
+			if (delta >= reach) expires = _now + reach - 1;
+
+			unsigned int slot = (expires >> (level * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+
+			node->heap_index = (level * TIMER_WHEEL_SLOTS) + slot;
+			_slots[node->heap_index].enqueue(node);
+		}
+
+		void cascade(unsigned int level, unsigned int slot) {
+			RunqueueRing& ring = _slots[(level * TIMER_WHEEL_SLOTS) + slot];
+
+			while (!ring.empty()) {
+				RunqueueNode *node = ring.head();
+
+				ring.remove(node);
+				file(node);
+			}
+		}
+
+		void expire(RunqueueNode *node) {
+			node->heap_index = EXPIRED_SLOT;
+			_expired.enqueue(node);
+		}
+
+		RunqueueRing _slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+		RunqueueRing _expired;
+
+		// The time the wheel has been advanced to, and the number of nodes on it (including expired ones).
+		uint64_t _now;
+		unsigned int _count;
+	};
+}
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,248 @@
+/*
+ * Generates tar archives, optionally wrapped in an LZ4 frame, for the host tools.
+ */
+#ifndef HOST_ARCHIVE_BUILDER_H
+#define HOST_ARCHIVE_BUILDER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "random.h"
+
+namespace host {
+
+	/**
+	 * The contents generated for a file: every byte is a function of the file's seed and
+	 * position, so a reader can be checked without keeping the data around.  Files are
+	 * half compressible text and half noise, depending on the seed.
+	 */
+	static inline uint8_t file_byte(uint64_t seed, uint64_t pos)
+	{
+		if (seed & 1) return "the quick brown fox jumps over the lazy dog\n"[(pos + seed) % 44];
+
+		uint64_t x = (seed << 32) ^ pos;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		return (uint8_t) x;
+	}
+
+	/**
+	 * Builds a ustar archive in memory.
+	 */
+	class ArchiveBuilder {
+	public:
+		struct Entry {
+			std::string name;
+			uint64_t size, seed;
+			bool directory;
+			// The offset of the header within the archive.
+			size_t header_offset;
+		};
+
+		void add_directory(const std::string& name) {
+			add_header(name, 0, '5', 0);
+		}
+
+		void add_file(const std::string& name, uint64_t size, uint64_t seed) {
+			add_header(name, size, '0', seed);
+
+			size_t start = _data.size();
+			_data.resize(start + pad(size));
+			for (uint64_t i = 0; i < size; i++) {
+				_data[start + i] = file_byte(seed, i);
+			}
+		}
+
+		/**
+		 * Adds a pax extended header carrying a size record, which overrides the size of the
+		 * entry that follows.
+		 */
+		void add_pax_size(uint64_t size) {
+			char record[64];
+			char body[48];
+			snprintf(body, sizeof(body), " size=%llu\n", (unsigned long long) size);
+
+			// The record length counts its own digits.
+			size_t len = strlen(body) + 1;
+			while (snprintf(record, sizeof(record), "%zu%s", len, body) != (int) len) len++;
+
+			_data.resize(_data.size() + 512);
+			write_header(&_data[_data.size() - 512], "PaxHeader", len, 'x');
+
+			size_t start = _data.size();
+			_data.resize(start + pad(len));
+			memcpy(&_data[start], record, len);
+		}
+
+		/**
+		 * Ends the archive with the two zero blocks, and returns it.
+		 */
+		const std::vector<uint8_t>& finish() {
+			_data.resize(_data.size() + 1024);
+			return _data;
+		}
+
+		const std::vector<Entry>& entries() const { return _entries; }
+
+		static size_t pad(uint64_t size) {
+			return (size + 511) & ~(uint64_t) 511;
+		}
+
+		/**
+		 * Fills in a header block, including its checksum.
+		 */
+		static void write_header(uint8_t *block, const std::string& name, uint64_t size, char typeflag) {
+			memset(block, 0, 512);
+			memcpy(block, name.c_str(), name.size() < 100 ? name.size() : 99);
+
+			snprintf((char *) block + 100, 8, "%07o", 0644);
+			snprintf((char *) block + 108, 8, "%07o", 0);
+			snprintf((char *) block + 116, 8, "%07o", 0);
+			snprintf((char *) block + 124, 12, "%011llo", (unsigned long long) size);
+			snprintf((char *) block + 136, 12, "%011o", 0);
+			block[156] = typeflag;
+			memcpy(block + 257, "ustar", 6);
+			memcpy(block + 263, "00", 2);
+
+			update_checksum(block);
+		}
+
+		/**
+		 * Recomputes the checksum of a header block, after it has been changed.
+		 */
+		static void update_checksum(uint8_t *block) {
+			memset(block + 148, ' ', 8);
+
+			unsigned int sum = 0;
+			for (unsigned int i = 0; i < 512; i++) sum += block[i];
+
+			snprintf((char *) block + 148, 8, "%06o", sum);
+			block[155] = ' ';
+		}
+
+	private:
+		void add_header(const std::string& name, uint64_t size, char typeflag, uint64_t seed) {
+			Entry entry = { name, size, seed, typeflag == '5', _data.size() };
+			_entries.push_back(entry);
+
+			_data.resize(_data.size() + 512);
+			write_header(&_data[_data.size() - 512], name, size, typeflag);
+		}
+
+		std::vector<uint8_t> _data;
+		std::vector<Entry> _entries;
+	};
+
+	/**
+	 * Compresses one LZ4 block, greedily, with a hash table of four-byte sequences.
+	 * @return Returns the compressed block.
+	 */
+	static inline std::vector<uint8_t> lz4_compress_block(const uint8_t *src, size_t size)
+	{
+		std::vector<uint8_t> out;
+		std::vector<int64_t> table(1 << 16, -1);
+
+		auto put_length = [&out](size_t length) {
+			while (length >= 255) {
+				out.push_back(255);
+				length -= 255;
+			}
+			out.push_back((uint8_t) length);
+		};
+
+		auto put_literals = [&](size_t anchor, size_t end, size_t match_length) {
+			size_t literals = end - anchor;
+			size_t match_code = match_length == 0 ? 0 : match_length - 4;
+
+			out.push_back((uint8_t) (((literals < 15 ? literals : 15) << 4) | (match_code < 15 ? match_code : 15)));
+			if (literals >= 15) put_length(literals - 15);
+
+			out.insert(out.end(), src + anchor, src + end);
+		};
+
+		// The last match must start 12 bytes before the end, and the last 5 bytes are always literals.
+		size_t anchor = 0, i = 0;
+		size_t match_limit = size > 12 ? size - 12 : 0;
+
+		while (i < match_limit) {
+			uint32_t sequence;
+			memcpy(&sequence, src + i, 4);
+
+			uint32_t hash = (sequence * 2654435761U) >> 16;
+			int64_t candidate = table[hash];
+			table[hash] = i;
+
+			if (candidate < 0 || i - candidate > 65535 || memcmp(src + candidate, src + i, 4) != 0) {
+				i++;
+				continue;
+			}
+
+			size_t length = 4;
+			while (i + length < size - 5 && src[candidate + length] == src[i + length]) length++;
+
+			put_literals(anchor, i, length);
+
+			size_t offset = i - candidate;
+			out.push_back((uint8_t) offset);
+			out.push_back((uint8_t) (offset >> 8));
+
+			if (length - 4 >= 15) put_length(length - 4 - 15);
+
+			i += length;
+			anchor = i;
+		}
+
+		put_literals(anchor, size, 0);
+		return out;
+	}
+
+	static inline void put_le32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) out.push_back((uint8_t) (value >> (8 * i)));
+	}
+
+	/**
+	 * Wraps data in an LZ4 frame of independent blocks, as `lz4 -B<block_size_id>` would.
+	 * Blocks that do not compress are stored uncompressed.
+	 * @param block_size_id The block size code: 4 (64KiB) to 7 (4MiB).
+	 * @param content_size Whether to record the decompressed size in the frame header.
+	 */
+	static inline std::vector<uint8_t> lz4_frame(const std::vector<uint8_t>& data, unsigned int block_size_id, bool content_size)
+	{
+		std::vector<uint8_t> out;
+		size_t block_max_size = (size_t) 1 << (8 + (2 * block_size_id));
+
+		put_le32(out, 0x184D2204);
+		out.push_back(0x60 | (content_size ? 0x08 : 0));
+		out.push_back((uint8_t) (block_size_id << 4));
+		if (content_size) {
+			put_le32(out, (uint32_t) data.size());
+			put_le32(out, (uint32_t) ((uint64_t) data.size() >> 32));
+		}
+		// The header checksum is not checked by the reader.
+		out.push_back(0);
+
+		for (size_t pos = 0; pos < data.size(); pos += block_max_size) {
+			size_t length = data.size() - pos < block_max_size ? data.size() - pos : block_max_size;
+			std::vector<uint8_t> block = lz4_compress_block(&data[pos], length);
+
+			if (block.size() >= length) {
+				put_le32(out, 0x80000000U | (uint32_t) length);
+				out.insert(out.end(), data.begin() + pos, data.begin() + pos + length);
+			} else {
+				put_le32(out, (uint32_t) block.size());
+				out.insert(out.end(), block.begin(), block.end());
+			}
+		}
+
+		put_le32(out, 0);
+		return out;
+	}
+}
+
+#endif
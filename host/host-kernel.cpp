@@ -0,0 +1,223 @@
+/*
+ * Host stand-ins for the kernel services the coursework uses: the clock, the system log,
+ * the page allocator, formatted printing, device classes, filesystem and scheduler
+ * registration, and command-line arguments.  Only what the host tools need is provided.
+ */
+#include "host-kernel.h"
+
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/util/lock.h>
+#include <infos/util/printf.h>
+#include <infos/drivers/block/block-device.h>
+#include <infos/fs/filesystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <mutex>
+
+#include "../coursework/shrinker.h"
+
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace infos::drivers;
+using namespace infos::drivers::block;
+using namespace infos::fs;
+
+namespace host {
+	__thread unsigned int irq_depth;
+	std::recursive_mutex cpu_lock;
+
+	LogLevel::LogLevel log_threshold = LogLevel::WARNING;
+	uint64_t messages_logged_with_irqs_off;
+
+	static const unsigned int MAX_FILESYSTEMS = 8;
+	static struct { const char *name; FilesystemFactory factory; } filesystems[MAX_FILESYSTEMS];
+	static unsigned int nr_filesystems;
+
+	FilesystemFactory find_filesystem(const char *name)
+	{
+		for (unsigned int i = 0; i < nr_filesystems; i++) {
+			if (strcmp(filesystems[i].name, name) == 0) return filesystems[i].factory;
+		}
+
+		return NULL;
+	}
+
+	infos::kernel::SchedulingAlgorithm *find_scheduler(const char *name)
+	{
+		for (SchedulingAlgorithm *algorithm = SchedulingAlgorithm::registered; algorithm != NULL; algorithm = algorithm->next_registered) {
+			if (strcmp(algorithm->name(), name) == 0) return algorithm;
+		}
+
+		return NULL;
+	}
+
+	static CmdLineArgument *cmdline_arguments;
+
+	CmdLineArgument::CmdLineArgument(const char *name, Handler handler) : name(name), handler(handler), next(cmdline_arguments)
+	{
+		cmdline_arguments = this;
+	}
+
+	unsigned int set_cmdline_argument(const char *name, const char *value)
+	{
+		unsigned int nr_called = 0;
+
+		for (CmdLineArgument *argument = cmdline_arguments; argument != NULL; argument = argument->next) {
+			if (strcmp(argument->name, name) == 0) {
+				argument->handler(value);
+				nr_called++;
+			}
+		}
+
+		return nr_called;
+	}
+}
+
+namespace infos {
+	namespace kernel {
+		Kernel sys;
+		Log syslog;
+
+		SchedulingAlgorithm *SchedulingAlgorithm::registered;
+
+		SchedulingAlgorithm::SchedulingAlgorithm() : next_registered(registered)
+		{
+			registered = this;
+		}
+
+		void Log::message(LogLevel::LogLevel level, const char *message)
+		{
+			if (host::irq_depth > 0) __atomic_fetch_add(&host::messages_logged_with_irqs_off, 1, __ATOMIC_RELAXED);
+			if (level < host::log_threshold) return;
+
+			// Informational lines (such as statistics) go with the tools' own results, on stdout.
+			static const char *names[] = { "debug", "info", "warning", "error", "fatal" };
+			fprintf(level <= LogLevel::INFO ? stdout : stderr, "%s: %s\n", names[level], message);
+		}
+
+		void Log::messagef(LogLevel::LogLevel level, const char *format, ...)
+		{
+			char buffer[1024];
+			va_list args;
+
+			va_start(args, format);
+			::vsnprintf(buffer, sizeof(buffer), format, args);
+			va_end(args);
+
+			message(level, buffer);
+		}
+	}
+
+	namespace mm {
+		// The kernel's page allocator does its own locking, so readers on other threads may call it.
+		static std::mutex page_allocator_lock;
+
+		PageDescriptor *PageAllocator::alloc_pages(int order)
+		{
+			std::lock_guard<std::mutex> l(page_allocator_lock);
+
+			if (_fail_after == 0) return NULL;
+			if (_fail_after > 0) _fail_after--;
+
+			size_t size = (size_t) 4096 << order;
+
+			PageDescriptor *pgd = new PageDescriptor();
+			pgd->vpa = aligned_alloc(4096, size);
+			pgd->order = order;
+
+			// Fresh pages are filled with garbage, so that code relying on zeroed pages shows up.
+			memset(pgd->vpa, 0xA5, size);
+
+			_pages_in_use += (uint64_t) 1 << order;
+			return pgd;
+		}
+
+		void PageAllocator::free_pages(PageDescriptor *pgd, int order)
+		{
+			std::lock_guard<std::mutex> l(page_allocator_lock);
+
+			if (pgd->order != order) {
+				fprintf(stderr, "fatal: free_pages order %d does not match allocation order %d\n", order, pgd->order);
+				abort();
+			}
+
+			_pages_in_use -= (uint64_t) 1 << order;
+
+			free(pgd->vpa);
+			delete pgd;
+		}
+	}
+
+	namespace util {
+		int vsnprintf(char *buffer, size_t size, const char *format, va_list args)
+		{
+			return ::vsnprintf(buffer, size, format, args);
+		}
+
+		int snprintf(char *buffer, size_t size, const char *format, ...)
+		{
+			va_list args;
+
+			va_start(args, format);
+			int rc = ::vsnprintf(buffer, size, format, args);
+			va_end(args);
+
+			return rc;
+		}
+	}
+
+	namespace drivers {
+		const DeviceClass Device::RootDeviceClass("device");
+
+		namespace block {
+			const DeviceClass BlockDevice::BlockDeviceClass(Device::RootDeviceClass, "block");
+		}
+	}
+
+	namespace fs {
+		FilesystemRegistration::FilesystemRegistration(const char *name, FilesystemFactory factory)
+		{
+			if (host::nr_filesystems < host::MAX_FILESYSTEMS) {
+				host::filesystems[host::nr_filesystems].name = name;
+				host::filesystems[host::nr_filesystems].factory = factory;
+				host::nr_filesystems++;
+			}
+		}
+	}
+}
+
+namespace reclaim {
+	ReclaimStats reclaim_stats;
+
+	static Shrinker *shrinkers[8];
+	static unsigned int nr_shrinkers;
+
+	void register_shrinker(Shrinker& shrinker)
+	{
+		for (unsigned int i = 0; i < nr_shrinkers; i++) {
+			if (shrinkers[i] == &shrinker) return;
+		}
+
+		if (nr_shrinkers < 8) shrinkers[nr_shrinkers++] = &shrinker;
+	}
+
+	uint64_t shrink_caches(uint64_t nr_pages)
+	{
+		uint64_t reclaimed = 0;
+
+		reclaim_stats.reclaim_runs++;
+
+		for (unsigned int i = 0; i < nr_shrinkers && reclaimed < nr_pages; i++) {
+			reclaimed += shrinkers[i]->shrink(nr_pages - reclaimed);
+		}
+
+		reclaim_stats.reclaimed_pages += reclaimed;
+		return reclaimed;
+	}
+}
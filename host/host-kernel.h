@@ -0,0 +1,25 @@
+/*
+ * Host stand-ins for kernel services, and the hooks the host tools use to drive them.
+ */
+#ifndef HOST_KERNEL_H
+#define HOST_KERNEL_H
+
+#include <infos/kernel/log.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/fs/filesystem.h>
+
+namespace host {
+	// Messages below this level are not printed.
+	extern infos::kernel::LogLevel::LogLevel log_threshold;
+	// The number of messages that were logged while a UniqueIRQLock was held.
+	extern uint64_t messages_logged_with_irqs_off;
+
+	// Returns the factory of a registered filesystem, or NULL.
+	infos::fs::FilesystemFactory find_filesystem(const char *name);
+
+	// Returns the registered scheduling algorithm with the given name, or NULL.
+	infos::kernel::SchedulingAlgorithm *find_scheduler(const char *name);
+}
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_ASSERT_H
+#define HOST_INFOS_ASSERT_H
+
+#include <assert.h>
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_DEFINE_H
+#define HOST_INFOS_DEFINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define __packed __attribute__((packed))
+
+#endif
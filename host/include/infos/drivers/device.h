@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_DRIVERS_DEVICE_H
+#define HOST_INFOS_DRIVERS_DEVICE_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace drivers {
+		class DeviceClass {
+		public:
+			DeviceClass(const DeviceClass& parent, const char *name) : _parent(&parent), _name(name) { }
+			DeviceClass(const char *name) : _parent(NULL), _name(name) { }
+
+			bool is(const DeviceClass& other) const {
+				for (const DeviceClass *cls = this; cls != NULL; cls = cls->_parent) {
+					if (cls == &other) return true;
+				}
+				return false;
+			}
+
+		private:
+			const DeviceClass *_parent;
+			const char *_name;
+		};
+
+		class Device {
+		public:
+			static const DeviceClass RootDeviceClass;
+
+			virtual ~Device() { }
+			virtual const DeviceClass& device_class() const { return RootDeviceClass; }
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_FS_BLOCK_BASED_FILESYSTEM_H
+#define HOST_INFOS_FS_BLOCK_BASED_FILESYSTEM_H
+
+#include <infos/fs/filesystem.h>
+#include <infos/drivers/block/block-device.h>
+
+namespace infos {
+	namespace fs {
+		class BlockBasedFilesystem : public Filesystem {
+		public:
+			BlockBasedFilesystem(infos::drivers::block::BlockDevice& bdev) : _bdev(bdev) { }
+
+			infos::drivers::block::BlockDevice& block_device() const { return _bdev; }
+
+		private:
+			infos::drivers::block::BlockDevice& _bdev;
+		};
+	}
+}
+
+#endif
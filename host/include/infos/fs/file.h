@@ -0,0 +1,26 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_FS_FILE_H
+#define HOST_INFOS_FS_FILE_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace fs {
+		class File {
+		public:
+			enum SeekType { SeekAbsolute, SeekRelative };
+
+			virtual ~File() { }
+
+			virtual void close() = 0;
+			virtual int read(void *buffer, size_t size) = 0;
+			virtual int pread(void *buffer, size_t size, off_t off) = 0;
+			virtual int write(const void *buffer, size_t size) = 0;
+			virtual void seek(off_t offset, SeekType type) = 0;
+		};
+	}
+}
+
+#endif
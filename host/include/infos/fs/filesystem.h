@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_FS_FILESYSTEM_H
+#define HOST_INFOS_FS_FILESYSTEM_H
+
+#include <infos/define.h>
+#include <infos/util/string.h>
+#include <infos/drivers/device.h>
+
+namespace infos {
+	namespace fs {
+		class PFSNode;
+		class VirtualFilesystem;
+
+		class Filesystem {
+		public:
+			virtual ~Filesystem() { }
+			virtual PFSNode *mount() = 0;
+		};
+
+		typedef Filesystem *(*FilesystemFactory)(VirtualFilesystem& vfs, infos::drivers::Device *dev);
+
+		struct FilesystemRegistration {
+			FilesystemRegistration(const char *name, FilesystemFactory factory);
+		};
+	}
+}
+
+#define RegisterFilesystem(_name, _factory) \
+	static infos::fs::FilesystemRegistration __filesystem_registration_##_name(#_name, _factory)
+
+#endif
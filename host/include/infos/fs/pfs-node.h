@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_FS_PFS_NODE_H
+#define HOST_INFOS_FS_PFS_NODE_H
+
+#include <infos/fs/filesystem.h>
+
+namespace infos {
+	namespace fs {
+		class File;
+		class Directory;
+
+		class PFSNode {
+		public:
+			PFSNode(PFSNode *parent, Filesystem& owner) : _parent(parent), _owner(owner) { }
+			virtual ~PFSNode() { }
+
+			virtual File *open() = 0;
+			virtual Directory *opendir() = 0;
+			virtual PFSNode *get_child(const infos::util::String& name) = 0;
+			virtual PFSNode *mkdir(const infos::util::String& name) = 0;
+
+			PFSNode *parent() const { return _parent; }
+			Filesystem& owner() const { return _owner; }
+
+		private:
+			PFSNode *_parent;
+			Filesystem& _owner;
+		};
+	}
+}
+
+#endif
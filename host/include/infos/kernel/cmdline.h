@@ -0,0 +1,30 @@
+/*
+ * Host stand-in for the InfOS kernel headers.  Command-line arguments register themselves
+ * in a list, so that the host tools can pass them values by name.
+ */
+#ifndef HOST_INFOS_KERNEL_CMDLINE_H
+#define HOST_INFOS_KERNEL_CMDLINE_H
+
+#include <infos/define.h>
+
+namespace host {
+	struct CmdLineArgument {
+		typedef void (*Handler)(const char *value);
+
+		CmdLineArgument(const char *name, Handler handler);
+
+		const char *name;
+		Handler handler;
+		CmdLineArgument *next;
+	};
+
+	// Calls the handler of every argument with the given name.  Returns the number called.
+	unsigned int set_cmdline_argument(const char *name, const char *value);
+}
+
+#define RegisterCmdLineArgument(_name, _arg) \
+	static void __cmdline_arg_handler_##_name(const char *value); \
+	static host::CmdLineArgument __cmdline_arg_##_name(_arg, __cmdline_arg_handler_##_name); \
+	static void __cmdline_arg_handler_##_name(const char *value)
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_KERNEL_KERNEL_H
+#define HOST_INFOS_KERNEL_KERNEL_H
+
+#include <infos/define.h>
+#include <infos/mm/mm.h>
+
+namespace infos {
+	namespace kernel {
+		class Kernel {
+		public:
+			Kernel() : _runtime_ticks(0) { }
+
+			uint64_t runtime_ticks() const { return _runtime_ticks; }
+			infos::mm::MemoryManager& mm() { return _mm; }
+
+			// Host only: advances the clock.
+			void advance_ticks(uint64_t ticks) { _runtime_ticks += ticks; }
+
+		private:
+			uint64_t _runtime_ticks;
+			infos::mm::MemoryManager _mm;
+		};
+
+		extern Kernel sys;
+	}
+}
+
+#endif
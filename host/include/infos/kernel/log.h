@@ -0,0 +1,30 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_KERNEL_LOG_H
+#define HOST_INFOS_KERNEL_LOG_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		namespace LogLevel {
+			enum LogLevel { DEBUG, INFO, WARNING, ERROR, FATAL };
+		}
+
+		class Log {
+		public:
+			Log(const char *component = NULL) : _component(component) { }
+
+			void message(LogLevel::LogLevel level, const char *message);
+			void messagef(LogLevel::LogLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+		private:
+			const char *_component;
+		};
+
+		extern Log syslog;
+	}
+}
+
+#endif
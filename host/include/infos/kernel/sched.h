@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the InfOS kernel headers.  Schedulers register themselves in a list,
+ * so that the host tools can find them by name.
+ */
+#ifndef HOST_INFOS_KERNEL_SCHED_H
+#define HOST_INFOS_KERNEL_SCHED_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		class SchedulingEntity {
+		public:
+			typedef int EntityPriority;
+
+			SchedulingEntity() : _priority(0) { }
+			virtual ~SchedulingEntity() { }
+
+			EntityPriority priority() const { return _priority; }
+
+			// Host only: sets the priority.
+			void priority(EntityPriority priority) { _priority = priority; }
+
+		private:
+			EntityPriority _priority;
+		};
+
+		class SchedulingAlgorithm {
+		public:
+			SchedulingAlgorithm();
+			virtual ~SchedulingAlgorithm() { }
+
+			virtual const char *name() const = 0;
+			virtual void init() { }
+			virtual void add_to_runqueue(SchedulingEntity& entity) = 0;
+			virtual void remove_from_runqueue(SchedulingEntity& entity) = 0;
+			virtual SchedulingEntity *pick_next_entity() = 0;
+
+			// Host only: the registered algorithms.
+			SchedulingAlgorithm *next_registered;
+			static SchedulingAlgorithm *registered;
+		};
+	}
+}
+
+#define RegisterScheduler(_class) static _class __sched_alg_##_class
+
+#endif
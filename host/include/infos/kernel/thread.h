@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_KERNEL_THREAD_H
+#define HOST_INFOS_KERNEL_THREAD_H
+
+#include <infos/kernel/sched.h>
+
+#endif
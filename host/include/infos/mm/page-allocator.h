@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_MM_PAGE_ALLOCATOR_H
+#define HOST_INFOS_MM_PAGE_ALLOCATOR_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace mm {
+		struct PageDescriptor {
+			void *vpa;
+			int order;
+		};
+
+		/**
+		 * Hands out page-aligned memory from the host heap, and counts what is outstanding.
+		 */
+		class PageAllocator {
+		public:
+			PageAllocator() : _pages_in_use(0), _fail_after(-1) { }
+
+			PageDescriptor *alloc_pages(int order);
+			void free_pages(PageDescriptor *pgd, int order);
+			void *pgd_to_vpa(PageDescriptor *pgd) { return pgd->vpa; }
+
+			// Host only: the number of pages outstanding, and fault injection.
+			uint64_t pages_in_use() const { return _pages_in_use; }
+			void fail_after(long nr_allocations) { _fail_after = nr_allocations; }
+
+		private:
+			uint64_t _pages_in_use;
+			long _fail_after;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_UTIL_LIST_H
+#define HOST_INFOS_UTIL_LIST_H
+
+#include <infos/define.h>
+#include <vector>
+
+namespace infos {
+	namespace util {
+		template<typename T>
+		class List {
+		public:
+			void append(const T& value) { _items.push_back(value); }
+			unsigned int count() const { return _items.size(); }
+			T& at(unsigned int index) { return _items.at(index); }
+			const T& at(unsigned int index) const { return _items.at(index); }
+
+		private:
+			std::vector<T> _items;
+		};
+	}
+}
+
+#endif
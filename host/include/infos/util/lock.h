@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the InfOS kernel headers.  InfOS runs on a single CPU, where disabling
+ * interrupts keeps every other thread off the CPU.  On the host, threads really do run at
+ * once, so "disabling interrupts" takes one recursive lock shared by every thread, which
+ * excludes them in the same way.  It is also tracked as a depth counter, so that the host
+ * tools can check what runs with interrupts off.
+ */
+#ifndef HOST_INFOS_UTIL_LOCK_H
+#define HOST_INFOS_UTIL_LOCK_H
+
+#include <infos/define.h>
+#include <mutex>
+
+namespace host {
+	extern __thread unsigned int irq_depth;
+	extern std::recursive_mutex cpu_lock;
+}
+
+namespace infos {
+	namespace util {
+		class UniqueIRQLock {
+		public:
+			UniqueIRQLock() { host::cpu_lock.lock(); host::irq_depth++; }
+			~UniqueIRQLock() { host::irq_depth--; host::cpu_lock.unlock(); }
+		};
+
+		class Mutex {
+		public:
+			void lock() { _mutex.lock(); }
+			void unlock() { _mutex.unlock(); }
+
+		private:
+			std::mutex _mutex;
+		};
+
+		template<typename T>
+		class UniqueLock {
+		public:
+			UniqueLock(T& lock) : _lock(lock) { _lock.lock(); }
+			~UniqueLock() { _lock.unlock(); }
+
+		private:
+			T& _lock;
+		};
+	}
+}
+
+#endif
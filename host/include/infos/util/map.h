@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_UTIL_MAP_H
+#define HOST_INFOS_UTIL_MAP_H
+
+#include <infos/define.h>
+#include <map>
+
+namespace infos {
+	namespace util {
+		template<typename K, typename V>
+		class Map {
+		public:
+			void add(const K& key, const V& value) { _items[key] = value; }
+			void remove(const K& key) { _items.erase(key); }
+			unsigned int count() const { return _items.size(); }
+
+			bool try_get_value(const K& key, V& value) const {
+				auto it = _items.find(key);
+				if (it == _items.end()) return false;
+
+				value = it->second;
+				return true;
+			}
+
+		private:
+			std::map<K, V> _items;
+		};
+	}
+}
+
+#endif
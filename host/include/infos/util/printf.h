@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_UTIL_PRINTF_H
+#define HOST_INFOS_UTIL_PRINTF_H
+
+#include <infos/define.h>
+#include <stdarg.h>
+
+namespace infos {
+	namespace util {
+		int snprintf(char *buffer, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+		int vsnprintf(char *buffer, size_t size, const char *format, va_list args);
+	}
+}
+
+#endif
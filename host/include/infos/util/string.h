@@ -0,0 +1,56 @@
+/*
+ * Host stand-in for the InfOS kernel headers.
+ */
+#ifndef HOST_INFOS_UTIL_STRING_H
+#define HOST_INFOS_UTIL_STRING_H
+
+#include <infos/define.h>
+#include <infos/util/list.h>
+#include <string>
+
+namespace infos {
+	namespace util {
+		class String {
+		public:
+			typedef uint64_t hash_type;
+
+			String() { }
+			String(const char *value) : _value(value) { }
+
+			const char *c_str() const { return _value.c_str(); }
+			unsigned int length() const { return _value.size(); }
+
+			hash_type get_hash() const {
+				// FNV-1a, as a deterministic stand-in for the kernel's string hash.
+				hash_type hash = 0xcbf29ce484222325ULL;
+				for (char c : _value) {
+					hash = (hash ^ (uint8_t) c) * 0x100000001b3ULL;
+				}
+				return hash;
+			}
+
+			List<String> split(char delimiter, bool remove_empty) const {
+				List<String> parts;
+				std::string part;
+
+				for (size_t i = 0; i <= _value.size(); i++) {
+					if (i == _value.size() || _value[i] == delimiter) {
+						if (!remove_empty || !part.empty()) parts.append(String(part.c_str()));
+						part.clear();
+					} else {
+						part += _value[i];
+					}
+				}
+
+				return parts;
+			}
+
+			bool operator==(const String& other) const { return _value == other._value; }
+
+		private:
+			std::string _value;
+		};
+	}
+}
+
+#endif
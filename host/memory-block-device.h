@@ -0,0 +1,76 @@
+/*
+ * An in-memory block device, for running filesystems on the host.
+ */
+#ifndef HOST_MEMORY_BLOCK_DEVICE_H
+#define HOST_MEMORY_BLOCK_DEVICE_H
+
+#include <infos/drivers/block/block-device.h>
+
+#include <stdio.h>
+#include <vector>
+
+namespace host {
+
+	/**
+	 * A block device backed by a byte vector.  The image is padded out to a whole number of
+	 * blocks.  Reads past the end of the device fail, and are counted, rather than crashing.
+	 */
+	class MemoryBlockDevice : public infos::drivers::block::BlockDevice {
+	public:
+		MemoryBlockDevice(const std::vector<uint8_t>& image, size_t block_size = 512)
+			: _image(image), _block_size(block_size), _reads(0), _blocks_read(0), _bad_reads(0) {
+			_image.resize(((_image.size() + block_size - 1) / block_size) * block_size);
+		}
+
+		/**
+		 * Loads a device image from a file.
+		 * @return Returns FALSE if the file could not be read.
+		 */
+		static bool load_image(const char *path, std::vector<uint8_t>& image) {
+			FILE *f = fopen(path, "rb");
+			if (f == NULL) return false;
+
+			uint8_t buffer[65536];
+			size_t n;
+			while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+				image.insert(image.end(), buffer, buffer + n);
+			}
+
+			bool ok = !ferror(f);
+			fclose(f);
+			return ok;
+		}
+
+		size_t block_size() const override { return _block_size; }
+		size_t block_count() const override { return _image.size() / _block_size; }
+
+		bool read_blocks(void *buffer, size_t offset, size_t count) override {
+			if (offset > block_count() || count > block_count() - offset) {
+				__atomic_fetch_add(&_bad_reads, 1, __ATOMIC_RELAXED);
+				return false;
+			}
+
+			memcpy(buffer, &_image[offset * _block_size], count * _block_size);
+
+			// Readers on several threads may share the device.
+			__atomic_fetch_add(&_reads, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&_blocks_read, count, __ATOMIC_RELAXED);
+			return true;
+		}
+
+		bool write_blocks(const void *buffer, size_t offset, size_t count) override {
+			return false;
+		}
+
+		uint64_t reads() const { return _reads; }
+		uint64_t blocks_read() const { return _blocks_read; }
+		uint64_t bad_reads() const { return _bad_reads; }
+
+	private:
+		std::vector<uint8_t> _image;
+		size_t _block_size;
+		uint64_t _reads, _blocks_read, _bad_reads;
+	};
+}
+
+#endif
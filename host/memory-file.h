@@ -0,0 +1,59 @@
+/*
+ * An in-memory file, for taking the output of File::send_to() transfers on the host.
+ */
+#ifndef HOST_MEMORY_FILE_H
+#define HOST_MEMORY_FILE_H
+
+#include <infos/fs/file.h>
+
+#include <string.h>
+#include <vector>
+
+namespace host {
+
+	/**
+	 * A write-only file that collects what is written to it.  Each write accepts at most
+	 * max_write bytes, and the file fills up after capacity bytes, so that destinations
+	 * taking short writes can be tested.  Without keeping the data, writes are copied into
+	 * a small scratch buffer instead, so that the cost of consuming them is still paid.
+	 */
+	class MemoryFile : public infos::fs::File {
+	public:
+		MemoryFile(bool keep = true, size_t max_write = (size_t) -1, size_t capacity = (size_t) -1)
+			: _keep(keep), _max_write(max_write), _capacity(capacity), _written(0), _scratch(65536) { }
+
+		void close() override { }
+		int read(void *buffer, size_t size) override { return -1; }
+		int pread(void *buffer, size_t size, off_t off) override { return -1; }
+		void seek(off_t offset, SeekType type) override { }
+
+		int write(const void *buffer, size_t size) override {
+			if (size > _max_write) size = _max_write;
+			if (size > _capacity - _written) size = _capacity - _written;
+
+			if (_keep) {
+				_data.insert(_data.end(), (const uint8_t *) buffer, (const uint8_t *) buffer + size);
+			} else {
+				for (size_t done = 0; done < size; done += _scratch.size()) {
+					size_t amount = size - done < _scratch.size() ? size - done : _scratch.size();
+					memcpy(_scratch.data(), (const uint8_t *) buffer + done, amount);
+				}
+			}
+
+			_written += size;
+			return size;
+		}
+
+		const std::vector<uint8_t>& data() const { return _data; }
+		uint64_t bytes_written() const { return _written; }
+
+	private:
+		bool _keep;
+		size_t _max_write, _capacity;
+		uint64_t _written;
+		std::vector<uint8_t> _data;
+		std::vector<uint8_t> _scratch;
+	};
+}
+
+#endif
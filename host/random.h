@@ -0,0 +1,36 @@
+/*
+ * A deterministic random number generator, for the host tools.
+ */
+#ifndef HOST_RANDOM_H
+#define HOST_RANDOM_H
+
+#include <stdint.h>
+
+namespace host {
+
+	/**
+	 * A small deterministic random number generator (xorshift64*), so that generated
+	 * archives and workloads are the same on every run and every host.
+	 */
+	class Random {
+	public:
+		Random(uint64_t seed) : _state(seed * 2685821657736338717ULL + 1) { }
+
+		uint64_t next() {
+			_state ^= _state >> 12;
+			_state ^= _state << 25;
+			_state ^= _state >> 27;
+			return _state * 2685821657736338717ULL;
+		}
+
+		// Returns a number in [0, bound).
+		uint64_t below(uint64_t bound) {
+			return bound == 0 ? 0 : next() % bound;
+		}
+
+	private:
+		uint64_t _state;
+	};
+}
+
+#endif
@@ -0,0 +1,588 @@
+/*
+ * Scheduler simulator: drives the coursework scheduling algorithms, one tick at a time,
+ * with simulated tasks, and reports how each policy served them.  Each result is printed as
+ * one line of key=value pairs, so that runs can be compared by a script.
+ *
+ *   sched-sim [--ticks N] [--sched NAME] [--workload NAME] [--arg KEY=VALUE]... [--stats] [TRACE...]
+ *
+ * With no traces, the synthetic workloads are run under every scheduler.  A trace replays a
+ * recorded workload: each line is one task, as "<priority> <start tick> <cpu> <sleep> <cpu>
+ * <sleep> ...", and the task exits after its last phase.  Lines starting with # are ignored.
+ *
+ * Each tick is a scheduling event: sleeps that have ended are woken, the scheduler picks, and
+ * the picked task runs for the tick.  If the scheduler can tell when it does not need the
+ * tick (see sched-tick.h), the tick is stopped after such a pick, and the picked task runs on
+ * without picks until a task is added to or removed from the runqueue.  A task that finishes a CPU phase blocks for its sleep
+ * phase through remove_from_runqueue.  If the scheduler has timed wakeups, the sleep is armed
+ * with them, and the task is only known to be awake when the scheduler picks it again.
+ *
+ * Tasks may carry per-entity parameters for some schedulers, which are set when the task
+ * starts (see sched-entity.h); tasks report their exit when they finish, and when the run ends.
+ *
+ * The simulator also checks the schedulers: they must not pick a task that is blocked or wake
+ * one early, must release every interrupt lock they take, and must not log with interrupts
+ * disabled.  The exit code is non-zero if any check failed.
+ */
+#include "host-kernel.h"
+#include "random.h"
+
+#include "../coursework/sched-entity.h"
+#include "../coursework/sched-sleep.h"
+#include "../coursework/sched-tick.h"
+
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/sched.h>
+#include <infos/util/lock.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace infos::kernel;
+using namespace host;
+
+// The schedulers to compare, in the order they are reported.
+static const char *schedulers[] = { "fifo", "rr", "mlfq", "edf", "stride" };
+
+// The scheduler parameters the workloads are designed around.  --arg adds to or overrides them.
+static const char *default_args[] = {
+	"sched.rr.quantum=4",
+	"sched.rr.adaptive=1",
+	"sched.stride.tickets=0:100,1:200,2:300",
+	"sched.edf.reserve=0:3:10:10",
+};
+
+struct Task : public SchedulingEntity {
+	enum State { NOT_STARTED, RUNNABLE, SLEEPING, TIMED_SLEEP, EXITED };
+
+	// The task's phases, alternately CPU and sleep, in ticks, and whether they repeat.  A
+	// periodic task instead has one CPU phase, released every period.
+	std::vector<uint64_t> phases;
+	bool repeat;
+	uint64_t period, start;
+
+	// Per-entity parameters to set when the task starts, by scheduler.
+	std::map<std::string, std::vector<uint64_t>> parameters;
+
+	State state;
+	size_t phase;
+	uint64_t left, wake_at, ready_since, release;
+	bool waiting;
+
+	uint64_t cpu_ticks, completions, job_misses;
+};
+
+struct Workload {
+	std::string name;
+	std::vector<Task *> tasks;
+};
+
+struct Result {
+	uint64_t busy_ticks, idle_ticks, switches, completions, job_misses, parameters_rejected, stopped_ticks, failures;
+	std::vector<uint64_t> waits;
+	std::vector<uint64_t> pick_ns;
+};
+
+static Task *new_task(unsigned int priority, uint64_t start, const std::vector<uint64_t>& phases, bool repeat, uint64_t period = 0)
+{
+	Task *task = new Task();
+
+	task->priority(priority);
+	task->phases = phases;
+	task->repeat = repeat;
+	task->period = period;
+	task->start = start;
+
+	return task;
+}
+
+/**
+ * Entities that never block.
+ */
+static Workload cpu_bound()
+{
+	Workload workload = { "cpu-bound", { } };
+
+	for (unsigned int i = 0; i < 8; i++) {
+		workload.tasks.push_back(new_task(0, i, { 1000000 }, true));
+	}
+
+	return workload;
+}
+
+/**
+ * Entities that run in short bursts between sleeps.
+ */
+static Workload io_bound()
+{
+	Workload workload = { "io-bound", { } };
+	Random random(1);
+
+	for (unsigned int i = 0; i < 16; i++) {
+		workload.tasks.push_back(new_task(0, i, { 1 + random.below(3), 5 + random.below(40) }, true));
+	}
+
+	return workload;
+}
+
+/**
+ * Interactive entities at a higher priority than CPU-bound ones.
+ */
+static Workload mixed()
+{
+	Workload workload = { "mixed", { } };
+	Random random(2);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		workload.tasks.push_back(new_task(1, i, { 1000000 }, true));
+	}
+
+	for (unsigned int i = 0; i < 8; i++) {
+		workload.tasks.push_back(new_task(0, i, { 1 + random.below(2), 10 + random.below(30) }, true));
+	}
+
+	return workload;
+}
+
+/**
+ * CPU-bound entities in three classes, for comparing the shares they get with their tickets,
+ * and one in the first class that is given tickets (and a round-robin quantum) of its own.
+ */
+static Workload shares()
+{
+	Workload workload = { "shares", { } };
+
+	for (unsigned int i = 0; i < 3; i++) {
+		workload.tasks.push_back(new_task(i, 0, { 1000000 }, true));
+	}
+
+	workload.tasks.push_back(new_task(0, 0, { 1000000 }, true));
+	workload.tasks.back()->parameters["stride"] = { 400 };
+	workload.tasks.back()->parameters["rr"] = { 8 };
+
+	return workload;
+}
+
+/**
+ * Periodic real-time entities, with deadlines at the end of each period, over CPU-bound
+ * background entities.  Each asks for a reservation that covers its jobs, and the last asks
+ * for more bandwidth than is left, so it is not admitted.
+ */
+static Workload periodic()
+{
+	Workload workload = { "periodic", { } };
+
+	for (unsigned int i = 0; i < 3; i++) {
+		workload.tasks.push_back(new_task(0, i, { 2 }, false, 10));
+		workload.tasks.back()->parameters["edf"] = { 2, 10, 10 };
+	}
+
+	workload.tasks.push_back(new_task(1, 3, { 5 }, false, 10));
+	workload.tasks.back()->parameters["edf"] = { 5, 10, 10 };
+
+	for (unsigned int i = 0; i < 2; i++) {
+		workload.tasks.push_back(new_task(1, 0, { 1000000 }, true));
+	}
+
+	return workload;
+}
+
+static bool load_trace(const char *path, Workload& workload)
+{
+	std::ifstream file(path);
+	if (!file) return false;
+
+	workload.name = path;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream fields(line);
+		uint64_t priority, start, value;
+		std::vector<uint64_t> phases;
+
+		if (!(fields >> priority >> start)) return false;
+		while (fields >> value) {
+			// CPU phases must not be empty.
+			if (value == 0 && phases.size() % 2 == 0) return false;
+			phases.push_back(value);
+		}
+		if (phases.empty()) return false;
+
+		workload.tasks.push_back(new_task(priority, start, phases, false));
+	}
+
+	return true;
+}
+
+static void fail(Result& result, const char *sched, const Workload& workload, uint64_t tick, const char *what)
+{
+	if (result.failures++ < 10) {
+		fprintf(stderr, "sched-sim: sched=%s workload=%s tick=%lu: %s\n", sched, workload.name.c_str(), tick, what);
+	}
+}
+
+static void check_irqs(Result& result, const char *sched, const Workload& workload, uint64_t tick)
+{
+	if (irq_depth != 0) {
+		fail(result, sched, workload, tick, "interrupt lock still held after a scheduler call");
+		irq_depth = 0;
+	}
+
+	if (messages_logged_with_irqs_off > 0) {
+		fail(result, sched, workload, tick, "logged with interrupts disabled");
+		messages_logged_with_irqs_off = 0;
+	}
+}
+
+/**
+ * Blocks a task for a number of ticks, counting from the start of the next tick.
+ */
+static void block(SchedulingAlgorithm& algorithm, sched_sleep::TimedWakeups *timed, Task *task, uint64_t now, uint64_t wake_at)
+{
+	task->wake_at = wake_at;
+
+	if (timed != NULL) {
+		timed->wake_after(*task, wake_at - now);
+		task->state = Task::TIMED_SLEEP;
+	} else {
+		task->state = Task::SLEEPING;
+	}
+
+	algorithm.remove_from_runqueue(*task);
+}
+
+/**
+ * Moves a task on once it has used up its current CPU phase.
+ */
+static void end_phase(SchedulingAlgorithm& algorithm, sched_sleep::TimedWakeups *timed, sched_entity::EntityParameters *params,
+	Task *task, uint64_t now)
+{
+	task->completions++;
+
+	// A periodic job's deadline is the next release.
+	if (task->period != 0) {
+		uint64_t deadline = task->release + task->period;
+		if (now + 1 > deadline) task->job_misses++;
+
+		task->release = deadline;
+		task->left = task->phases[0];
+
+		if (deadline > now + 1) block(algorithm, timed, task, now, deadline);
+		return;
+	}
+
+	// The next phase is a sleep, unless the CPU phase was the last.
+	task->phase++;
+
+	uint64_t sleep = 0;
+	if (task->phase < task->phases.size()) sleep = task->phases[task->phase++];
+
+	if (task->phase == task->phases.size()) {
+		if (!task->repeat) {
+			task->state = Task::EXITED;
+			algorithm.remove_from_runqueue(*task);
+			if (params != NULL) params->entity_exited(*task);
+			return;
+		}
+
+		task->phase = 0;
+	}
+
+	task->left = task->phases[task->phase];
+	if (sleep > 0) block(algorithm, timed, task, now, now + 1 + sleep);
+}
+
+static Result simulate(const char *sched, SchedulingAlgorithm& algorithm, Workload& workload, uint64_t nr_ticks)
+{
+	Result result;
+	result.busy_ticks = result.idle_ticks = result.switches = result.completions = result.job_misses = result.failures = 0;
+	result.parameters_rejected = result.stopped_ticks = 0;
+
+	sched_sleep::TimedWakeups *timed = sched_sleep::timed_wakeups_of(algorithm);
+	sched_entity::EntityParameters *params = sched_entity::entity_parameters_of(algorithm);
+	sched_tick::PreemptionTicks *preemption_ticks = sched_tick::preemption_ticks_of(algorithm);
+
+	for (Task *task : workload.tasks) {
+		task->state = Task::NOT_STARTED;
+		task->phase = 0;
+		task->left = task->phases[0];
+		task->waiting = false;
+		task->cpu_ticks = task->completions = task->job_misses = 0;
+	}
+
+	uint64_t first = sys.runtime_ticks();
+	Task *last = NULL;
+
+	// Whether the timer interrupts this tick.  Otherwise the last task picked runs on.
+	bool interrupt = true;
+
+	for (uint64_t tick = 0; tick < nr_ticks; tick++) {
+		uint64_t now = first + tick;
+
+		for (Task *task : workload.tasks) {
+			if ((task->state == Task::NOT_STARTED && task->start <= tick) || (task->state == Task::SLEEPING && task->wake_at <= now)) {
+				if (task->state == Task::NOT_STARTED) {
+					task->release = now;
+
+					auto parameters = task->parameters.find(sched);
+					if (params != NULL && parameters != task->parameters.end() &&
+						!params->set_parameters(*task, parameters->second.data(), parameters->second.size())) {
+						result.parameters_rejected++;
+					}
+
+					check_irqs(result, sched, workload, now);
+				}
+
+				task->ready_since = task->state == Task::SLEEPING ? task->wake_at : now;
+				task->state = Task::RUNNABLE;
+				task->waiting = true;
+
+				algorithm.add_to_runqueue(*task);
+				check_irqs(result, sched, workload, now);
+
+				interrupt = true;
+			}
+		}
+
+		Task *task = last;
+		if (interrupt) {
+			auto start = std::chrono::steady_clock::now();
+			task = (Task *) algorithm.pick_next_entity();
+			result.pick_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+			check_irqs(result, sched, workload, now);
+
+			if (preemption_ticks != NULL) {
+				interrupt = preemption_ticks->needs_preemption_tick();
+				check_irqs(result, sched, workload, now);
+			}
+		} else {
+			result.stopped_ticks++;
+		}
+
+		if (task == NULL) {
+			result.idle_ticks++;
+		} else {
+			// A task sleeping on a timed wakeup is awake once it is picked, and then wakes itself up.
+			if (task->state == Task::TIMED_SLEEP) {
+				if (task->wake_at > now) fail(result, sched, workload, now, "task woken before its sleep ended");
+
+				task->state = Task::RUNNABLE;
+				task->ready_since = task->wake_at;
+				task->waiting = true;
+
+				algorithm.add_to_runqueue(*task);
+				check_irqs(result, sched, workload, now);
+
+				interrupt = true;
+			}
+
+			if (task->state != Task::RUNNABLE) {
+				fail(result, sched, workload, now, "picked a task that is not runnable");
+				task = NULL;
+			}
+		}
+
+		if (task != NULL) {
+			if (task->waiting) {
+				result.waits.push_back(now - task->ready_since);
+				task->waiting = false;
+			}
+
+			if (task != last) result.switches++;
+
+			result.busy_ticks++;
+			task->cpu_ticks++;
+
+			if (--task->left == 0) {
+				end_phase(algorithm, timed, params, task, now);
+				check_irqs(result, sched, workload, now);
+
+				interrupt = true;
+			}
+		}
+
+		last = task;
+
+		sys.advance_ticks(1);
+	}
+
+	uint64_t end = sys.runtime_ticks();
+
+	// Tasks still waiting count with the time they have waited so far, so starvation shows.
+	for (Task *task : workload.tasks) {
+		if (task->state == Task::RUNNABLE && task->waiting) result.waits.push_back(end - task->ready_since);
+
+		result.completions += task->completions;
+		result.job_misses += task->job_misses;
+	}
+
+	// Take every task off the scheduler, and have them all exit, so that the next run starts afresh.
+	for (Task *task : workload.tasks) {
+		// A timed sleep may already have ended, with the task back on the runqueue.
+		if (task->state == Task::TIMED_SLEEP) timed->cancel_wakeup(*task);
+		if (task->state == Task::RUNNABLE || task->state == Task::TIMED_SLEEP) algorithm.remove_from_runqueue(*task);
+		if (params != NULL && task->state != Task::EXITED) params->entity_exited(*task);
+	}
+
+	sys.advance_ticks(1000000);
+	if (algorithm.pick_next_entity() != NULL) fail(result, sched, workload, end, "scheduler still picks a task after every task has left");
+	check_irqs(result, sched, workload, end);
+
+	return result;
+}
+
+static uint64_t percentile(std::vector<uint64_t>& values, double fraction)
+{
+	if (values.empty()) return 0;
+
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (size_t) (fraction * values.size()))];
+}
+
+static double mean(const std::vector<uint64_t>& values)
+{
+	double sum = 0;
+	for (uint64_t value : values) sum += value;
+
+	return values.empty() ? 0.0 : sum / values.size();
+}
+
+/**
+ * Returns Jain's fairness index of the CPU time that the tasks that never sleep received:
+ * 1 when they all got the same, down to 1/n when one got everything.
+ */
+static double fairness(const Workload& workload)
+{
+	double sum = 0, sum_squares = 0;
+	unsigned int n = 0;
+
+	for (const Task *task : workload.tasks) {
+		if (task->phases.size() != 1 || task->period != 0) continue;
+
+		sum += task->cpu_ticks;
+		sum_squares += (double) task->cpu_ticks * task->cpu_ticks;
+		n++;
+	}
+
+	return sum_squares == 0 ? 1.0 : (sum * sum) / (n * sum_squares);
+}
+
+/**
+ * Formats the share of the CPU each task received, in task order.
+ */
+static std::string shares_of(const Workload& workload, uint64_t busy_ticks)
+{
+	std::string shares;
+	char share[32];
+
+	for (const Task *task : workload.tasks) {
+		snprintf(share, sizeof(share), "%s%.3f", shares.empty() ? "" : ",", busy_ticks ? (double) task->cpu_ticks / busy_ticks : 0.0);
+		shares += share;
+	}
+
+	return shares;
+}
+
+static void report(const char *sched, const Workload& workload, Result& result, uint64_t nr_ticks)
+{
+	double wait_mean = mean(result.waits), pick_mean = mean(result.pick_ns);
+	uint64_t wait_p99 = percentile(result.waits, 0.99), wait_max = percentile(result.waits, 1.0);
+	uint64_t pick_p99 = percentile(result.pick_ns, 0.99);
+
+	printf("sim=sched sched=%s workload=%s ticks=%lu tasks=%zu busy_ticks=%lu idle_ticks=%lu switches=%lu completions=%lu "
+		"throughput_per_1k=%.1f wait_mean=%.2f wait_p99=%lu wait_max=%lu fairness=%.3f shares=%s job_misses=%lu "
+		"parameters_rejected=%lu stopped_ticks=%lu pick_ns_mean=%.0f pick_ns_p99=%lu failures=%lu\n",
+		sched, workload.name.c_str(), nr_ticks, workload.tasks.size(), result.busy_ticks, result.idle_ticks, result.switches,
+		result.completions, (result.completions * 1000.0) / nr_ticks, wait_mean, wait_p99, wait_max, fairness(workload),
+		shares_of(workload, result.busy_ticks).c_str(), result.job_misses, result.parameters_rejected, result.stopped_ticks, pick_mean, pick_p99,
+		result.failures);
+	fflush(stdout);
+}
+
+static bool set_argument(const char *argument)
+{
+	const char *equals = strchr(argument, '=');
+	if (equals == NULL) return false;
+
+	std::string name(argument, equals - argument);
+	return set_cmdline_argument(name.c_str(), equals + 1) > 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t nr_ticks = 100000;
+	const char *only_sched = NULL, *only_workload = NULL;
+	std::vector<const char *> args(default_args, default_args + sizeof(default_args) / sizeof(default_args[0]));
+	std::vector<const char *> paths;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--stats") == 0) log_threshold = LogLevel::DEBUG;
+		else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) nr_ticks = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "--sched") == 0 && i + 1 < argc) only_sched = argv[++i];
+		else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc) only_workload = argv[++i];
+		else if (strcmp(argv[i], "--arg") == 0 && i + 1 < argc) args.push_back(argv[++i]);
+		else paths.push_back(argv[i]);
+	}
+
+	for (const char *argument : args) {
+		if (!set_argument(argument)) {
+			fprintf(stderr, "sched-sim: unknown argument %s\n", argument);
+			return 1;
+		}
+	}
+
+	std::vector<Workload> workloads;
+	if (paths.empty()) {
+		workloads = { cpu_bound(), io_bound(), mixed(), shares(), periodic() };
+	} else {
+		for (const char *path : paths) {
+			Workload workload;
+			if (!load_trace(path, workload)) {
+				fprintf(stderr, "sched-sim: cannot read trace %s\n", path);
+				return 1;
+			}
+
+			workloads.push_back(workload);
+		}
+	}
+
+	uint64_t failures = 0;
+
+	for (const char *sched : schedulers) {
+		if (only_sched != NULL && strcmp(sched, only_sched) != 0) continue;
+
+		SchedulingAlgorithm *algorithm = find_scheduler(sched);
+		if (algorithm == NULL) {
+			fprintf(stderr, "sched-sim: no scheduler called %s\n", sched);
+			return 1;
+		}
+
+		algorithm->init();
+
+		for (Workload& workload : workloads) {
+			if (only_workload != NULL && workload.name != only_workload) continue;
+
+			Result result = simulate(sched, *algorithm, workload, nr_ticks);
+			report(sched, workload, result, nr_ticks);
+
+			failures += result.failures;
+		}
+	}
+
+	for (Workload& workload : workloads) {
+		for (Task *task : workload.tasks) delete task;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
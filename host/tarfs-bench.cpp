@@ -0,0 +1,328 @@
+/*
+ * TarFS benchmarks: mounts generated (or given) archives from an in-memory block device,
+ * and measures mount time and read throughput, from one thread and from several at once, and
+ * how send_to() compares with copying a file through a read/write loop.  Each result is printed as one line of
+ * key=value pairs, so that runs can be compared by a script.
+ *
+ *   tarfs-bench [--quick] [--stats] [ARCHIVE...]
+ *
+ * With no archives, the generated workloads are run, each as a raw and an LZ4 archive, followed
+ * by a header-parsing case that mounts an archive of 100k empty files and reports headers/sec.
+ */
+#include "host-kernel.h"
+#include "memory-block-device.h"
+#include "memory-file.h"
+#include "archive-builder.h"
+
+#include "../coursework/tarfs.h"
+
+#include <infos/kernel/kernel.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace infos::fs;
+using namespace infos::kernel;
+using namespace host;
+
+static uint64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Workload {
+	const char *name;
+	std::vector<uint8_t> archive;
+};
+
+/**
+ * Many small files, spread over a flat set of directories.
+ */
+static Workload small_files(bool quick)
+{
+	ArchiveBuilder builder;
+	Random random(1);
+
+	unsigned int nr_dirs = 50, nr_files = quick ? 1000 : 10000;
+	for (unsigned int d = 0; d < nr_dirs; d++) {
+		builder.add_directory("dir" + std::to_string(d) + "/");
+	}
+
+	for (unsigned int f = 0; f < nr_files; f++) {
+		builder.add_file("dir" + std::to_string(f % nr_dirs) + "/file" + std::to_string(f), 100 + random.below(4000), f);
+	}
+
+	return { "small-files", builder.finish() };
+}
+
+/**
+ * Files at the bottom of long chains of directories.
+ */
+static Workload deep_tree(bool quick)
+{
+	ArchiveBuilder builder;
+	Random random(2);
+
+	unsigned int nr_chains = quick ? 20 : 100, depth = 20;
+	for (unsigned int c = 0; c < nr_chains; c++) {
+		std::string path = "c" + std::to_string(c) + "/";
+		builder.add_directory(path);
+
+		for (unsigned int d = 0; d < depth; d++) {
+			path += "d" + std::to_string(d) + "/";
+			builder.add_directory(path);
+			builder.add_file(path + "f", random.below(8192), (c * depth) + d);
+		}
+	}
+
+	return { "deep-tree", builder.finish() };
+}
+
+/**
+ * A few huge files.
+ */
+static Workload huge_files(bool quick)
+{
+	ArchiveBuilder builder;
+
+	uint64_t size = quick ? (8ULL << 20) : (64ULL << 20);
+	for (unsigned int f = 0; f < 4; f++) {
+		builder.add_file("huge" + std::to_string(f), size + f, f);
+	}
+
+	return { "huge-files", builder.finish() };
+}
+
+/**
+ * 100k empty files, so that mounting is all header parsing and checksum validation.
+ */
+static Workload empty_files()
+{
+	ArchiveBuilder builder;
+
+	unsigned int nr_dirs = 100, nr_files = 100000;
+	for (unsigned int d = 0; d < nr_dirs; d++) {
+		builder.add_directory("h" + std::to_string(d) + "/");
+	}
+
+	for (unsigned int f = 0; f < nr_files; f++) {
+		builder.add_file("h" + std::to_string(f % nr_dirs) + "/e" + std::to_string(f), 0, f);
+	}
+
+	return { "headers", builder.finish() };
+}
+
+/**
+ * Collects every file node under a node.
+ */
+static void collect_files(tarfs::TarFSNode *node, std::vector<tarfs::TarFSNode *>& files)
+{
+	for (const tarfs::TarFSNode *child = node->first_child(); child != NULL; child = child->next_sibling()) {
+		if (child->has_block_offset()) files.push_back((tarfs::TarFSNode *) child);
+		collect_files((tarfs::TarFSNode *) child, files);
+	}
+}
+
+/**
+ * Reads small pieces at random offsets of random files from several threads at once.
+ * @return Returns the time taken, in microseconds.
+ */
+static uint64_t threaded_random_reads(const std::vector<tarfs::TarFSNode *>& files, unsigned int nr_threads, unsigned int nr_reads)
+{
+	std::vector<std::thread> threads;
+
+	uint64_t start = now_us();
+	for (unsigned int t = 0; t < nr_threads; t++) {
+		threads.emplace_back([&files, nr_threads, nr_reads, t]() {
+			Random random(100 + t);
+			std::vector<uint8_t> buffer(4096);
+
+			for (unsigned int i = t; i < nr_reads; i += nr_threads) {
+				tarfs::TarFSNode *node = files[random.below(files.size())];
+				if (node->size() == 0) continue;
+
+				File *file = node->open();
+				file->pread(buffer.data(), buffer.size(), random.below(node->size()));
+				delete file;
+			}
+		});
+	}
+
+	for (std::thread& thread : threads) thread.join();
+	return now_us() - start;
+}
+
+static void run(const char *workload, const char *format, const std::vector<uint8_t>& archive, bool quick)
+{
+	MemoryBlockDevice device(archive);
+
+	uint64_t start = now_us();
+	tarfs::TarFS *fs = new tarfs::TarFS(device);
+	tarfs::TarFSNode *root = (tarfs::TarFSNode *) fs->mount();
+	uint64_t mount_us = now_us() - start;
+	uint64_t mount_blocks = device.blocks_read();
+
+	std::vector<tarfs::TarFSNode *> files;
+	collect_files(root, files);
+
+	// Read every file from start to end, a buffer at a time.
+	std::vector<uint8_t> buffer(64 * 1024);
+	uint64_t seq_bytes = 0;
+
+	start = now_us();
+	for (tarfs::TarFSNode *node : files) {
+		File *file = node->open();
+
+		int rc;
+		while ((rc = file->read(buffer.data(), buffer.size())) > 0) seq_bytes += rc;
+
+		file->close();
+		delete file;
+	}
+	uint64_t seq_us = now_us() - start;
+
+	// Copy every file to another file, with send_to() and then with a read/write loop.
+	MemoryFile send_sink(false), copy_sink(false);
+
+	start = now_us();
+	for (tarfs::TarFSNode *node : files) {
+		tarfs::TarFSFile *file = (tarfs::TarFSFile *) node->open();
+
+		uint64_t off = 0;
+		int rc;
+		while (off < node->size() && (rc = file->send_to(send_sink, node->size() - off, off)) > 0) off += rc;
+
+		delete file;
+	}
+	uint64_t send_us = now_us() - start;
+
+	start = now_us();
+	for (tarfs::TarFSNode *node : files) {
+		File *file = node->open();
+
+		int rc;
+		while ((rc = file->read(buffer.data(), buffer.size())) > 0) copy_sink.write(buffer.data(), rc);
+
+		delete file;
+	}
+	uint64_t copy_us = now_us() - start;
+
+	printf("bench=tarfs-send workload=%s format=%s bytes=%lu send_us=%lu send_mib_s=%.1f copy_us=%lu copy_mib_s=%.1f\n",
+		workload, format, send_sink.bytes_written(),
+		send_us, send_us ? (send_sink.bytes_written() / 1048576.0) / (send_us / 1e6) : 0.0,
+		copy_us, copy_us ? (copy_sink.bytes_written() / 1048576.0) / (copy_us / 1e6) : 0.0);
+
+	// Read small pieces at random offsets of random files.
+	Random random(3);
+	unsigned int nr_random = quick ? 5000 : 100000;
+	uint64_t random_bytes = 0;
+
+	start = now_us();
+	for (unsigned int i = 0; i < nr_random && !files.empty(); i++) {
+		tarfs::TarFSNode *node = files[random.below(files.size())];
+		if (node->size() == 0) continue;
+
+		File *file = node->open();
+		int rc = file->pread(buffer.data(), 4096, random.below(node->size()));
+		if (rc > 0) random_bytes += rc;
+		delete file;
+	}
+	uint64_t random_us = now_us() - start;
+
+	printf("bench=tarfs workload=%s format=%s archive_bytes=%zu device_bytes=%zu files=%zu mount_us=%lu mount_blocks=%lu "
+		"seq_bytes=%lu seq_us=%lu seq_mib_s=%.1f random_reads=%u random_bytes=%lu random_us=%lu random_reads_s=%.0f device_blocks=%lu\n",
+		workload, format, archive.size(), device.block_count() * device.block_size(), files.size(), mount_us, mount_blocks,
+		seq_bytes, seq_us, seq_us ? (seq_bytes / 1048576.0) / (seq_us / 1e6) : 0.0,
+		nr_random, random_bytes, random_us, random_us ? nr_random / (random_us / 1e6) : 0.0,
+		device.blocks_read());
+
+	// The same random reads, shared between several threads.
+	for (unsigned int nr_threads = 2; nr_threads <= 4 && !files.empty(); nr_threads *= 2) {
+		uint64_t threads_us = threaded_random_reads(files, nr_threads, nr_random);
+
+		printf("bench=tarfs-threads workload=%s format=%s threads=%u random_reads=%u random_us=%lu random_reads_s=%.0f\n",
+			workload, format, nr_threads, nr_random, threads_us, threads_us ? nr_random / (threads_us / 1e6) : 0.0);
+	}
+
+	fs->dump_stats();
+	fflush(stdout);
+}
+
+/**
+ * Counts the nodes under a node.
+ */
+static unsigned int count_nodes(const tarfs::TarFSNode *node)
+{
+	unsigned int count = 0;
+	for (const tarfs::TarFSNode *child = node->first_child(); child != NULL; child = child->next_sibling()) {
+		count += 1 + count_nodes(child);
+	}
+
+	return count;
+}
+
+/**
+ * Mounts an archive and reports how many headers per second the mount parsed.  Every
+ * entry is one header block, so this is the throughput of the header-processing code
+ * together with building the tree.
+ */
+static void run_headers(const Workload& workload, const char *format, const std::vector<uint8_t>& archive)
+{
+	MemoryBlockDevice device(archive);
+
+	uint64_t start = now_us();
+	tarfs::TarFS *fs = new tarfs::TarFS(device);
+	tarfs::TarFSNode *root = (tarfs::TarFSNode *) fs->mount();
+	uint64_t mount_us = now_us() - start;
+
+	unsigned int entries = count_nodes(root);
+
+	printf("bench=tarfs-headers workload=%s format=%s archive_bytes=%zu entries=%u mount_us=%lu headers_s=%.0f\n",
+		workload.name, format, archive.size(), entries, mount_us, mount_us ? entries / (mount_us / 1e6) : 0.0);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = false;
+	std::vector<const char *> paths;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) quick = true;
+		else if (strcmp(argv[i], "--stats") == 0) log_threshold = LogLevel::INFO;
+		else paths.push_back(argv[i]);
+	}
+
+	if (!paths.empty()) {
+		for (const char *path : paths) {
+			std::vector<uint8_t> image;
+			if (!MemoryBlockDevice::load_image(path, image)) {
+				fprintf(stderr, "tarfs-bench: cannot read %s\n", path);
+				return 1;
+			}
+
+			run(path, "file", image, quick);
+		}
+
+		return 0;
+	}
+
+	Workload workloads[] = { small_files(quick), deep_tree(quick), huge_files(quick) };
+
+	for (const Workload& workload : workloads) {
+		run(workload.name, "raw", workload.archive, quick);
+		run(workload.name, "lz4-64k", lz4_frame(workload.archive, 4, false), quick);
+		run(workload.name, "lz4-256k", lz4_frame(workload.archive, 5, true), quick);
+	}
+
+	Workload headers = empty_files();
+	run_headers(headers, "raw", headers.archive);
+	run_headers(headers, "lz4-256k", lz4_frame(headers.archive, 5, true));
+
+	return 0;
+}
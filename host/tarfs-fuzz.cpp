@@ -0,0 +1,446 @@
+/*
+ * TarFS fuzzer: mounts randomly generated archives, most of them damaged, reads everything
+ * that mounted, and checks that nothing goes out of bounds (build with the sanitizers),
+ * that undamaged archives read back exactly, that send_to() transfers what read() returns, also from several threads at once, and that
+ * no cache pages are leaked.
+ *
+ *   tarfs-fuzz [--iterations N] [--seed S]
+ *
+ * The result is printed as one line of key=value pairs.  The exit code is non-zero if any
+ * check failed.
+ */
+#include "host-kernel.h"
+#include "memory-block-device.h"
+#include "memory-file.h"
+#include "archive-builder.h"
+
+#include "../coursework/tarfs.h"
+
+#include <infos/kernel/kernel.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace infos::fs;
+using namespace infos::kernel;
+using namespace host;
+
+enum Mutation {
+	NONE,
+	// A header field is overwritten, with the checksum fixed up, so that the header is still accepted.
+	HEADER_FIELD,
+	// Random bytes are flipped anywhere, so checksums may or may not catch it.
+	BYTE_FLIPS,
+	// The device ends early.
+	TRUNCATE,
+	// A pax header gives the next entry a size that may not fit.
+	PAX_SIZE,
+	NR_MUTATIONS
+};
+
+static const char *mutation_names[] = { "none", "header-field", "byte-flips", "truncate", "pax-size" };
+
+struct Counters {
+	uint64_t mounts, files_read, bytes_read, pages_mapped, failures;
+	uint64_t by_mutation[NR_MUTATIONS];
+};
+
+static void fail(Counters& counters, uint64_t seed, const char *what)
+{
+	fprintf(stderr, "tarfs-fuzz: seed %lu: %s\n", seed, what);
+	counters.failures++;
+}
+
+static ArchiveBuilder generate(Random& random)
+{
+	ArchiveBuilder builder;
+
+	unsigned int nr_entries = 1 + random.below(20);
+	for (unsigned int i = 0; i < nr_entries; i++) {
+		std::string name = "d" + std::to_string(random.below(4)) + "/";
+		if (random.below(4) == 0) {
+			builder.add_directory(name);
+			continue;
+		}
+
+		static const uint64_t sizes[] = { 0, 1, 511, 512, 513, 4095, 4096, 4097, 70000, 300000 };
+		uint64_t size = sizes[random.below(10)];
+
+		builder.add_file(name + "f" + std::to_string(i), size, random.next());
+	}
+
+	return builder;
+}
+
+/**
+ * Damages a header.  Numeric fields get garbage, huge values or base-256 encodings, and
+ * the type flag and name get arbitrary bytes.
+ */
+static void mutate_header(uint8_t *block, Random& random)
+{
+	switch (random.below(5)) {
+	case 0:
+		// Size: random digits and junk.
+		for (unsigned int i = 0; i < 12; i++) block[124 + i] = "01234567 \0x\377"[random.below(12)];
+		break;
+
+	case 1:
+		// Size: base-256, possibly enormous or negative.
+		block[124] = 0x80 | (uint8_t) random.below(256);
+		for (unsigned int i = 1; i < 12; i++) block[124 + i] = (uint8_t) random.next();
+		break;
+
+	case 2:
+		block[156] = (uint8_t) random.below(256);
+		break;
+
+	case 3:
+		// Names without terminators, or made of separators.
+		for (unsigned int i = 0; i < 100; i++) block[i] = random.below(2) ? '/' : (uint8_t) random.next();
+		break;
+
+	default:
+		block[156] = 'x';
+		break;
+	}
+
+	ArchiveBuilder::update_checksum(block);
+}
+
+static std::vector<uint8_t> mutate(ArchiveBuilder& builder, std::vector<uint8_t> archive, Mutation mutation, Random& random)
+{
+	const std::vector<ArchiveBuilder::Entry>& entries = builder.entries();
+
+	switch (mutation) {
+	case HEADER_FIELD: {
+		unsigned int nr_headers = 1 + random.below(3);
+		for (unsigned int i = 0; i < nr_headers; i++) {
+			mutate_header(&archive[entries[random.below(entries.size())].header_offset], random);
+		}
+		break;
+	}
+
+	case BYTE_FLIPS: {
+		unsigned int nr_flips = 1 + random.below(32);
+		for (unsigned int i = 0; i < nr_flips; i++) {
+			archive[random.below(archive.size())] ^= (uint8_t) (1 + random.below(255));
+		}
+		break;
+	}
+
+	case TRUNCATE:
+		archive.resize(random.below(archive.size()));
+		break;
+
+	case PAX_SIZE: {
+		// Rebuild with a pax header in front of a random entry.
+		ArchiveBuilder rebuilt;
+		size_t target = random.below(entries.size());
+
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (i == target) {
+				uint64_t size = random.below(2) ? random.next() : entries[i].size + random.below(4096);
+				rebuilt.add_pax_size(size);
+			}
+
+			if (entries[i].directory) rebuilt.add_directory(entries[i].name);
+			else rebuilt.add_file(entries[i].name, entries[i].size, entries[i].seed);
+		}
+
+		archive = rebuilt.finish();
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return archive;
+}
+
+/**
+ * Finds the node of a path, or NULL.
+ */
+static tarfs::TarFSNode *lookup(tarfs::TarFSNode *root, const std::string& path)
+{
+	PFSNode *node = root;
+	size_t start = 0;
+
+	while (node != NULL && start < path.size()) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos) end = path.size();
+
+		if (end > start) node = node->get_child(path.substr(start, end - start).c_str());
+		start = end + 1;
+	}
+
+	return (tarfs::TarFSNode *) node;
+}
+
+/**
+ * Reads every file under a node, in several ways, and checks that the ways agree.
+ */
+static void read_all(tarfs::TarFSNode *node, Random& random, Counters& counters, uint64_t seed)
+{
+	for (const tarfs::TarFSNode *child = node->first_child(); child != NULL; child = child->next_sibling()) {
+		tarfs::TarFSNode *file_node = (tarfs::TarFSNode *) child;
+
+		if (child->has_block_offset()) {
+			tarfs::TarFSFile *file = (tarfs::TarFSFile *) file_node->open();
+			uint64_t size = file->size();
+
+			std::vector<uint8_t> whole(size + 1);
+			int rc = file->read(whole.data(), whole.size());
+			if (rc < 0 || (uint64_t) rc != size) fail(counters, seed, "short read of a mounted file");
+
+			counters.files_read++;
+			counters.bytes_read += rc > 0 ? rc : 0;
+
+			// Reads at random offsets must match the whole-file read.
+			for (unsigned int i = 0; i < 8 && size > 0; i++) {
+				uint64_t off = random.below(size + 16);
+				std::vector<uint8_t> part(1 + random.below(70000));
+
+				rc = file->pread(part.data(), part.size(), off);
+				if (rc < 0 || (off >= size && rc != 0) || (off < size && memcmp(part.data(), &whole[off], rc) != 0)) {
+					fail(counters, seed, "pread does not match read");
+				}
+			}
+
+			// So must mapped pages, which are zero-filled past the end.
+			uint64_t nr_pages = (size + TARFS_PAGE_SIZE - 1) / TARFS_PAGE_SIZE;
+			for (uint64_t page = 0; page < nr_pages && page < 4; page++) {
+				infos::mm::PageDescriptor *pgd = file->map_page(page);
+				if (pgd == NULL) continue;
+
+				const uint8_t *data = (const uint8_t *) sys.mm().pgalloc().pgd_to_vpa(pgd);
+				uint64_t amount = size - (page * TARFS_PAGE_SIZE);
+				if (amount > TARFS_PAGE_SIZE) amount = TARFS_PAGE_SIZE;
+
+				if (memcmp(data, &whole[page * TARFS_PAGE_SIZE], amount) != 0) fail(counters, seed, "mapped page does not match read");
+
+				file->unmap_page(page);
+				counters.pages_mapped++;
+			}
+
+			if (file->map_page(nr_pages) != NULL) fail(counters, seed, "page past the end of the file was mapped");
+
+			// Transfers must match too, including into destinations that take short writes.
+			for (unsigned int i = 0; i < 4 && size > 0; i++) {
+				uint64_t off = random.below(size + 16);
+				size_t amount = random.below(size + 16);
+				bool short_writes = random.below(2);
+
+				MemoryFile dest(true, short_writes ? 1 + random.below(5000) : (size_t) -1, short_writes ? random.below(size + 1) : (size_t) -1);
+
+				rc = file->send_to(dest, amount, off);
+				uint64_t expected = off >= size ? 0 : (amount < size - off ? amount : size - off);
+
+				if (rc < 0 || (uint64_t) rc != dest.bytes_written() || (uint64_t) rc > expected || (!short_writes && (uint64_t) rc != expected)
+					|| (rc > 0 && memcmp(dest.data().data(), &whole[off], rc) != 0)) {
+					fail(counters, seed, "send_to does not match read");
+				}
+			}
+
+			file->close();
+			delete file;
+		}
+
+		read_all(file_node, random, counters, seed);
+	}
+}
+
+/**
+ * Checks that an undamaged archive mounted with exactly the files it was built from.
+ */
+static void verify(ArchiveBuilder& builder, tarfs::TarFSNode *root, Counters& counters, uint64_t seed)
+{
+	for (const ArchiveBuilder::Entry& entry : builder.entries()) {
+		if (entry.directory) continue;
+
+		tarfs::TarFSNode *node = lookup(root, entry.name);
+		if (node == NULL || !node->has_block_offset() || node->size() != entry.size) {
+			fail(counters, seed, "entry missing from an undamaged archive");
+			continue;
+		}
+
+		// Names may repeat, in which case the first entry wins.
+		File *file = node->open();
+		std::vector<uint8_t> data(entry.size);
+		file->read(data.data(), data.size());
+
+		bool first = true;
+		for (const ArchiveBuilder::Entry& other : builder.entries()) {
+			if (&other == &entry) break;
+			if (other.name == entry.name) first = false;
+		}
+
+		for (uint64_t i = 0; first && i < entry.size; i++) {
+			if (data[i] != file_byte(entry.seed, i)) {
+				fail(counters, seed, "file contents differ from the archive");
+				break;
+			}
+		}
+
+		delete file;
+	}
+}
+
+// The number of threads that read an undamaged archive at once.
+#define FUZZ_NR_THREADS 4
+
+/**
+ * Reads an undamaged archive from several threads at once.  Each thread reads pieces of
+ * random files at random offsets, and maps their pages, checking everything against the
+ * archive; meanwhile all of them share one open file, which read() must hand out exactly
+ * once between them.  The host UniqueIRQLock excludes other threads, as disabling
+ * interrupts does on the kernel's single CPU, so this checks that the chunk and page
+ * caches stay consistent when readers interleave.
+ */
+static void check_threaded(ArchiveBuilder& builder, tarfs::TarFSNode *root, Counters& counters, uint64_t seed)
+{
+	struct Target {
+		tarfs::TarFSNode *node;
+		const ArchiveBuilder::Entry *entry;
+	};
+
+	// Only the first entry of a name is what the tree holds.
+	std::vector<Target> targets;
+	for (const ArchiveBuilder::Entry& entry : builder.entries()) {
+		if (entry.directory || entry.size == 0) continue;
+
+		tarfs::TarFSNode *node = lookup(root, entry.name);
+		bool first = true;
+		for (const Target& target : targets) {
+			if (target.entry->name == entry.name) first = false;
+		}
+
+		if (node != NULL && first) targets.push_back({ node, &entry });
+	}
+
+	if (targets.empty()) return;
+
+	const Target& shared = targets[seed % targets.size()];
+	File *shared_file = shared.node->open();
+
+	std::atomic<uint64_t> mismatches(0), shared_bytes(0);
+	std::vector<std::thread> threads;
+
+	for (unsigned int t = 0; t < FUZZ_NR_THREADS; t++) {
+		threads.emplace_back([&, t]() {
+			Random random((seed * FUZZ_NR_THREADS) + t);
+			std::vector<uint8_t> buffer(8192);
+
+			for (unsigned int i = 0; i < 32; i++) {
+				const Target& target = targets[random.below(targets.size())];
+				uint64_t size = target.entry->size;
+
+				tarfs::TarFSFile *file = (tarfs::TarFSFile *) target.node->open();
+				uint64_t off = random.below(size);
+				int rc = file->pread(buffer.data(), 1 + random.below(buffer.size()), off);
+
+				for (int b = 0; b < rc; b++) {
+					if (buffer[b] != file_byte(target.entry->seed, off + b)) {
+						mismatches++;
+						break;
+					}
+				}
+
+				uint64_t page = random.below((size + TARFS_PAGE_SIZE - 1) / TARFS_PAGE_SIZE);
+				infos::mm::PageDescriptor *pgd = file->map_page(page);
+				if (pgd != NULL) {
+					const uint8_t *data = (const uint8_t *) sys.mm().pgalloc().pgd_to_vpa(pgd);
+					if (data[0] != file_byte(target.entry->seed, page * TARFS_PAGE_SIZE)) mismatches++;
+					file->unmap_page(page);
+				}
+
+				delete file;
+
+				// Take a turn at the shared file.
+				rc = shared_file->read(buffer.data(), 1 + random.below(1024));
+				if (rc > 0) shared_bytes += rc;
+			}
+
+			// Finish the shared file, so that the total can be checked.
+			int rc;
+			while ((rc = shared_file->read(buffer.data(), buffer.size())) > 0) shared_bytes += rc;
+		});
+	}
+
+	for (std::thread& thread : threads) thread.join();
+
+	if (mismatches > 0) fail(counters, seed, "a threaded read does not match the archive");
+	if (shared_bytes != shared.entry->size) fail(counters, seed, "threads sharing a file did not read it exactly once");
+
+	delete shared_file;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t iterations = 2000, first_seed = 1;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--iterations") == 0) iterations = strtoull(argv[i + 1], NULL, 0);
+		else if (strcmp(argv[i], "--seed") == 0) first_seed = strtoull(argv[i + 1], NULL, 0);
+	}
+
+	// Damaged archives are expected to log errors; only the checks here count.
+	log_threshold = LogLevel::FATAL;
+
+	Counters counters;
+	memset(&counters, 0, sizeof(counters));
+
+	for (uint64_t seed = first_seed; seed < first_seed + iterations; seed++) {
+		Random random(seed);
+
+		ArchiveBuilder builder = generate(random);
+		std::vector<uint8_t> archive = builder.finish();
+
+		// A third of the archives are compressed.
+		bool compressed = random.below(3) == 0;
+		Mutation mutation = (Mutation) random.below(NR_MUTATIONS);
+
+		// Header damage is done to the tar data, and device damage to what is stored.
+		if (compressed && (mutation == HEADER_FIELD || mutation == PAX_SIZE)) {
+			archive = lz4_frame(mutate(builder, archive, mutation, random), 4 + random.below(2), random.below(2));
+		} else if (compressed) {
+			archive = mutate(builder, lz4_frame(archive, 4 + random.below(2), random.below(2)), mutation, random);
+		} else {
+			archive = mutate(builder, archive, mutation, random);
+		}
+
+		counters.by_mutation[mutation]++;
+
+		MemoryBlockDevice device(archive);
+		tarfs::TarFS *fs = new tarfs::TarFS(device);
+		tarfs::TarFSNode *root = (tarfs::TarFSNode *) fs->mount();
+		counters.mounts++;
+
+		if (mutation == NONE) {
+			verify(builder, root, counters, seed);
+			check_threaded(builder, root, counters, seed);
+		}
+		read_all(root, random, counters, seed);
+
+		if (device.bad_reads() > 0) fail(counters, seed, "read past the end of the device");
+		if (messages_logged_with_irqs_off > 0) fail(counters, seed, "logged with interrupts disabled");
+
+		// Everything cached is unmapped by now, so reclaim must be able to take it all back.
+		fs->shrink(~0ULL);
+		if (sys.mm().pgalloc().pages_in_use() != 0) fail(counters, seed, "pages still in use after reclaim");
+
+		// The tree is not freed: TarFS never unmounts.
+	}
+
+	printf("fuzz=tarfs iterations=%lu first_seed=%lu mounts=%lu files_read=%lu bytes_read=%lu pages_mapped=%lu",
+		iterations, first_seed, counters.mounts, counters.files_read, counters.bytes_read, counters.pages_mapped);
+	for (unsigned int m = 0; m < NR_MUTATIONS; m++) printf(" %s=%lu", mutation_names[m], counters.by_mutation[m]);
+	printf(" failures=%lu\n", counters.failures);
+
+	return counters.failures == 0 ? 0 : 1;
+}